@@ -0,0 +1,96 @@
+#pragma once
+
+/*
+ * ByteBuffer is a growable queue of bytes: append at the back, consume from the front.
+ * Connection uses it for its send and receive buffers.
+ *
+ * Consuming just moves a read position forward; the consumed space is only reclaimed
+ * (by sliding the remaining bytes down) once it is at least as big as what's left, so
+ * consuming is O(1) amortized no matter how much is queued up behind it -- unlike
+ * erasing from the front of a std::vector, which moves everything that's left every time.
+ *
+ * The unconsumed bytes are always contiguous, so messages can be parsed in place:
+ *
+ *  if (buffer.size() >= 4 && buffer[0] == ...) {
+ *      std::memcpy(&value, buffer.data() + 1, 3);
+ *      buffer.consume(4);
+ *  }
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+struct ByteBuffer {
+    //bytes that haven't been consumed:
+    size_t size() const { return bytes.size() - head; }
+    bool empty() const { return bytes.size() == head; }
+
+    uint8_t *data() { return bytes.data() + head; }
+    uint8_t const *data() const { return bytes.data() + head; }
+
+    uint8_t &operator[](size_t i) { return bytes[head + i]; }
+    uint8_t const &operator[](size_t i) const { return bytes[head + i]; }
+
+    uint8_t const *begin() const { return data(); }
+    uint8_t const *end() const { return bytes.data() + bytes.size(); }
+
+    //add bytes to the back:
+    void append(void const *data_, size_t count) {
+        if (count == 0) return;
+        size_t at = bytes.size();
+        bytes.resize(at + count);
+        std::memcpy(bytes.data() + at, data_, count);
+    }
+
+    //drop bytes from the front:
+    void consume(size_t count) {
+        assert(count <= size());
+        head += count;
+        if (head == bytes.size()) {
+            //emptied: start over at the front (keeps capacity)
+            bytes.clear();
+            head = 0;
+        } else if (head >= bytes.size() - head) {
+            //at least half the storage is consumed bytes: slide the rest down (amortized O(1) per consumed byte)
+            bytes.erase(bytes.begin(), bytes.begin() + head);
+            head = 0;
+        }
+    }
+
+    void clear() {
+        bytes.clear();
+        head = 0;
+    }
+
+    //space already allocated past the back (prepare() up to this much won't reallocate):
+    size_t spare() const { return bytes.capacity() - bytes.size(); }
+
+    //for reading directly into the buffer: make room for 'count' more bytes at the back and return where they go,
+    // then call commit() with how many actually got written:
+    // (the room is zero-filled first, so keep 'count' to about what a read might actually write)
+    uint8_t *prepare(size_t count) {
+        reserved = bytes.size();
+        bytes.resize(reserved + count);
+        return bytes.data() + reserved;
+    }
+    void commit(size_t count) {
+        assert(reserved + count <= bytes.size());
+        bytes.resize(reserved + count);
+    }
+
+    //hand over the unconsumed bytes as a vector (leaves the buffer empty):
+    std::vector<uint8_t> take() {
+        if (head != 0) bytes.erase(bytes.begin(), bytes.begin() + head);
+        head = 0;
+        std::vector<uint8_t> ret;
+        ret.swap(bytes);
+        return ret;
+    }
+
+    //internals:
+    std::vector<uint8_t> bytes; //consumed bytes, then unconsumed bytes
+    size_t head = 0; //index of first unconsumed byte
+    size_t reserved = 0; //where prepare()'s space starts
+};
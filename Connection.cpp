@@ -24,12 +24,19 @@ typedef int ssize_t;
 #include <netinet/ip.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 #define closesocket close
 
 #endif
 
 #include "Connection.hpp"
+#include "IoUring.hpp"
 
 //------------------------------------------------------
 
@@ -38,6 +45,7 @@ typedef int ssize_t;
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <chrono>
 
 //NOTE: much of the sockets code herein is based on http-tweak's single-header http server
 // see: https://github.com/ixchow/http-tweak
@@ -52,8 +60,209 @@ void Connection::close() {
     }
 }
 
+void Connection::send_shared(std::shared_ptr<std::vector<uint8_t> const> const &buffer) {
+    assert(buffer);
+    if (buffer->empty()) return;
+    //whatever was already in send_buffer needs to go out first, so move it to the queue (no copy -- just hands over the storage):
+    if (!send_buffer.empty()) {
+        send_queue.emplace_back(std::make_shared<std::vector<uint8_t> const>(send_buffer.take()));
+    }
+    send_queue.emplace_back(buffer);
+}
+
+//---------------------------------
+//Helpers used by all the polling backends:
+
+//socket-related syscalls made by this thread (Server::poll adds up its share into Server::syscalls):
+static thread_local uint64_t syscall_count = 0;
+//...and the same for bytes moved and time spent blocked waiting for sockets (see Server::bytes_received, etc):
+static thread_local uint64_t recv_byte_count = 0;
+static thread_local uint64_t sent_byte_count = 0;
+static thread_local double wait_seconds = 0.0;
+
+//call 'wait' and count the time it takes as waiting:
+template<typename F>
+static auto timed_wait(F const &wait) {
+    auto before = std::chrono::steady_clock::now();
+    auto ret = wait();
+    wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+    return ret;
+}
+
+//drop 'sent' bytes from the front of c's outgoing data (queued buffers first):
+static void drop_sent(Connection &c, size_t sent) {
+    sent_byte_count += sent;
+    while (sent > 0 && !c.send_queue.empty()) {
+        size_t step = std::min(sent, c.send_queue.front()->size() - c.send_queue_offset);
+        c.send_queue_offset += step;
+        sent -= step;
+        if (c.send_queue_offset == c.send_queue.front()->size()) {
+            c.send_queue.pop_front();
+            c.send_queue_offset = 0;
+        }
+    }
+    c.send_buffer.consume(sent);
+}
+
+//accept one pending connection on listen_socket (returns false if there was none):
+static bool accept_connection(
+        char const *where,
+        std::list<Connection> &connections,
+        std::function<void(Connection *, Connection::Event event)> const &on_event,
+        Socket listen_socket,
+        bool nonblocking = false) { //also make the new socket non-blocking (needed for edge-triggered epoll)
+    Socket got = accept(listen_socket, nullptr, nullptr);
+    syscall_count += 1;
+    if (got == InvalidSocket) {
+        //oh well.
+        return false;
+    }
+#ifdef _WIN32
+    unsigned long one = 1;
+    if (0 != ioctlsocket(got, FIONBIO, &one)) {
+        closesocket(got);
+        return true;
+    }
+#else
+    if (nonblocking) fcntl(got, F_SETFL, fcntl(got, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    connections.emplace_back();
+    connections.back().socket = got;
+    std::cerr << "[" << where << "] client connected on " << connections.back().socket << "."
+              << std::endl; //INFO
+    if (on_event) on_event(&connections.back(), Connection::OnOpen);
+    return true;
+}
+
+//read available data from c into c.recv_buffer:
+// if until_would_block is set, keeps reading until recv() says there's nothing left (as edge-triggered epoll needs);
+// otherwise stops after a short read.
+static void recv_connection(
+        char const *where,
+        Connection &c,
+        std::function<void(Connection *, Connection::Event event)> const &on_event,
+        bool until_would_block) {
+    const uint32_t BufferSize = 20000;
+    static thread_local char *buffer = new char[BufferSize];
+    
+    while (c.socket != InvalidSocket) { //read until more data left to read
+#ifdef _WIN32
+        ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
+        syscall_count += 1;
+        size_t room = 0;
+#else
+        //read straight into the end of recv_buffer, with 'buffer' to catch anything past that:
+        // (prepare() zero-fills its room, so it's capped rather than covering all the spare capacity a past backlog left behind)
+        size_t room = std::min< size_t >(std::max< size_t >(4096, c.recv_buffer.spare()), BufferSize);
+        struct iovec iov[2];
+        iov[0].iov_base = c.recv_buffer.prepare(room);
+        iov[0].iov_len = room;
+        iov[1].iov_base = buffer;
+        iov[1].iov_len = BufferSize;
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        ssize_t ret = recvmsg(c.socket, &msg, MSG_DONTWAIT);
+        syscall_count += 1;
+        c.recv_buffer.commit(ret > 0 ? std::min(size_t(ret), room) : 0);
+#endif
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            //~no problem~ but no data
+            break;
+        } else if (ret <= 0 || ret > (ssize_t) (room + BufferSize)) {
+            //~problem~ so remove connection
+            if (ret == 0) {
+                std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+            } else if (ret < 0) {
+                std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno)
+                          << "), disconnecting." << std::endl;
+            } else {
+                std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting."
+                          << std::endl;
+            }
+            c.close();
+            if (on_event) on_event(&c, Connection::OnClose);
+            break;
+        } else { //ret > 0
+            recv_byte_count += size_t(ret);
+            if (size_t(ret) > room) c.recv_buffer.append(buffer, size_t(ret) - room);
+            if (on_event) on_event(&c, Connection::OnRecv);
+            if (!until_would_block && size_t(ret) < room + BufferSize) break; //ran out of data before buffer: no more data left to read
+        }
+    }
+}
+
+//send queued buffers (in order), then send_buffer, until everything is sent or the socket is full:
+// (returns false if the socket filled up)
+static bool send_connection(
+        char const *where,
+        Connection &c,
+        std::function<void(Connection *, Connection::Event event)> const &on_event) {
+    while (c.socket != InvalidSocket && c.sending()) {
+#ifdef _WIN32
+        //one buffer at a time:
+        uint8_t const *data;
+        size_t size;
+        if (!c.send_queue.empty()) {
+            data = c.send_queue.front()->data() + c.send_queue_offset;
+            size = c.send_queue.front()->size() - c.send_queue_offset;
+        } else {
+            data = c.send_buffer.data();
+            size = c.send_buffer.size();
+        }
+        ssize_t ret = send(c.socket, reinterpret_cast< char const * >(data), int(size), MSG_DONTWAIT);
+#else
+        //as many buffers as will fit in one call:
+        const size_t MaxPieces = 16;
+        struct iovec iov[MaxPieces];
+        size_t pieces = 0;
+        size_t size = 0;
+        size_t offset = c.send_queue_offset;
+        for (auto const &buffer: c.send_queue) {
+            if (pieces == MaxPieces) break;
+            iov[pieces].iov_base = const_cast< uint8_t * >(buffer->data() + offset);
+            iov[pieces].iov_len = buffer->size() - offset;
+            size += iov[pieces].iov_len;
+            offset = 0;
+            ++pieces;
+        }
+        if (pieces < MaxPieces && !c.send_buffer.empty()) {
+            iov[pieces].iov_base = const_cast< uint8_t * >(c.send_buffer.data());
+            iov[pieces].iov_len = c.send_buffer.size();
+            size += iov[pieces].iov_len;
+            ++pieces;
+        }
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = pieces;
+        ssize_t ret = sendmsg(c.socket, &msg, MSG_DONTWAIT);
+#endif
+        syscall_count += 1;
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            //~no problem~, but don't keep trying
+            return false;
+        } else if (ret <= 0 || ret > (ssize_t) size) {
+            if (ret < 0) {
+                std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
+            } else {
+                assert(ret == 0 || ret > (ssize_t) size);
+                std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of "
+                          << size << "], disconnecting." << std::endl;
+            }
+            c.close();
+            if (on_event) on_event(&c, Connection::OnClose);
+        } else { //ret seems reasonable
+            drop_sent(c, size_t(ret));
+        }
+    }
+    return true;
+}
+
 //---------------------------------
-//Polling helper used by both server and client:
+//select()-based polling, used by the client and (when not using epoll) the server:
+// (rebuilds the fd_sets every call, so costs O(connections), and can't handle sockets numbered FD_SETSIZE or above)
 void poll_connections(
         char const *where,
         std::list<Connection> &connections,
@@ -78,7 +287,7 @@ void poll_connections(
         if (c.socket != InvalidSocket) {
             max = std::max(max, int(c.socket));
             FD_SET(c.socket, &read_fds);
-            if (!c.send_buffer.empty()) {
+            if (c.sending()) {
                 FD_SET(c.socket, &write_fds);
             }
         }
@@ -89,7 +298,8 @@ void poll_connections(
         tv.tv_sec = std::lround(std::floor(timeout));
         tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
         //NOTE: on windows nfds is ignored -- https://msdn.microsoft.com/en-us/library/windows/desktop/ms740141(v=vs.85).aspx
-        int ret = select(max + 1, &read_fds, &write_fds, nullptr, &tv);
+        int ret = timed_wait([&]() { return select(max + 1, &read_fds, &write_fds, nullptr, &tv); });
+        syscall_count += 1;
         
         if (ret < 0) {
             std::cerr << "[" << where << "] Select returned an error; will attempt to read/write anyway." << std::endl;
@@ -101,96 +311,291 @@ void poll_connections(
     
     //add new connections as needed:
     if (listen_socket != InvalidSocket && FD_ISSET(listen_socket, &read_fds)) {
-        Socket got = accept(listen_socket, nullptr, nullptr);
-        if (got == InvalidSocket) {
-            //oh well.
-        } else {
-#ifdef _WIN32
-            unsigned long one = 1;
-            if (0 == ioctlsocket(got, FIONBIO, &one)) {
-#else
-            {
-#endif
-                connections.emplace_back();
-                connections.back().socket = got;
-                std::cerr << "[" << where << "] client connected on " << connections.back().socket << "."
-                          << std::endl; //INFO
-                if (on_event) on_event(&connections.back(), Connection::OnOpen);
-            }
-        }
+        accept_connection(where, connections, on_event, listen_socket);
     }
     
-    const uint32_t BufferSize = 20000;
-    static thread_local char *buffer = new char[BufferSize];
-    
     //process requests:
     for (auto &c: connections) {
         //only read from valid sockets marked readable:
         if (c.socket == InvalidSocket || !FD_ISSET(c.socket, &read_fds)) continue;
-        
-        while (true) { //read until more data left to read
-            ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
-            if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-                //~no problem~ but no data
-                break;
-            } else if (ret <= 0 || ret > (ssize_t) BufferSize) {
-                //~problem~ so remove connection
-                if (ret == 0) {
-                    std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
-                } else if (ret < 0) {
-                    std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno)
-                              << "), disconnecting." << std::endl;
-                } else {
-                    std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting."
-                              << std::endl;
-                }
-                c.close();
-                if (on_event) on_event(&c, Connection::OnClose);
-                break;
-            } else { //ret > 0
-                c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
-                if (on_event) on_event(&c, Connection::OnRecv);
-                if (ret < BufferSize) break; //ran out of data before buffer: no more data left to read
-            }
-        }
+        recv_connection(where, c, on_event, false);
     }
     
     //process responses:
     for (auto &c: connections) {
         //don't bother with connections unless they are valid, have something to send, and are marked writable:
-        if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
+        if (c.socket == InvalidSocket || !c.sending() || !FD_ISSET(c.socket, &write_fds)) continue;
+        send_connection(where, c, on_event);
+    }
+}
 
-#ifdef _WIN32
-        ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-#else
-        ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(),
-                           MSG_DONTWAIT);
-#endif
-        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-            //~no problem~, but don't keep trying
-            break;
-        } else if (ret <= 0 || ret > (ssize_t) c.send_buffer.size()) {
-            if (ret < 0) {
-                std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-            } else {
-                assert(ret == 0 || ret > (ssize_t) c.send_buffer.size());
-                std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of "
-                          << c.send_buffer.size() << "], disconnecting." << std::endl;
-            }
+#ifdef __linux__
+//---------------------------------
+//epoll-based polling for the server:
+// every socket is registered once (when accepted) in edge-triggered mode, so a poll only costs O(sockets with events)
+// -- plus a pass to flush connections that have something to send, since the game queues data on them directly.
+void poll_connections_epoll(
+        char const *where,
+        std::list<Connection> &connections,
+        std::function<void(Connection *, Connection::Event event)> const &on_event,
+        double timeout,
+        int epoll_fd,
+        Socket listen_socket) {
+    
+    //edge-triggered: registers a new connection, which starts out writable:
+    auto add_connection = [&](Connection &c) {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.ptr = &c;
+        syscall_count += 1;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c.socket, &event) != 0) {
+            std::cerr << "[" << where << "] epoll_ctl() returned error " << errno << "(" << strerror(errno)
+                      << "), disconnecting." << std::endl;
             c.close();
             if (on_event) on_event(&c, Connection::OnClose);
-        } else { //ret seems reasonable
-            c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
         }
+        c.writable = true;
+    };
+    
+    //send whatever is ready to go (if anything was, that counts as something happening, so don't wait for events):
+    bool sent = false;
+    for (auto &c: connections) {
+        if (c.socket == InvalidSocket || !c.writable || !c.sending()) continue;
+        if (!send_connection(where, c, on_event)) c.writable = false;
+        sent = true;
+    }
+    if (sent) timeout = 0.0;
+    
+    const int MaxEvents = 256;
+    static thread_local struct epoll_event events[MaxEvents];
+    int count = timed_wait([&]() {
+        return epoll_wait(epoll_fd, events, MaxEvents, int(std::lround(std::ceil(timeout * 1000.0))));
+    });
+    syscall_count += 1;
+    if (count < 0) {
+        if (errno != EINTR) {
+            std::cerr << "[" << where << "] epoll_wait() returned error " << errno << "(" << strerror(errno) << ")."
+                      << std::endl;
+        }
+        return;
+    }
+    
+    for (int e = 0; e < count; ++e) {
+        if (events[e].data.ptr == nullptr) {
+            //listen socket: accept everything waiting (edge-triggered, so there won't be another event for these):
+            while (accept_connection(where, connections, on_event, listen_socket, true)) {
+                if (connections.back().socket != InvalidSocket) add_connection(connections.back()); //(unless turned away)
+            }
+            continue;
+        }
+        
+        Connection &c = *reinterpret_cast<Connection *>(events[e].data.ptr);
+        if (c.socket == InvalidSocket) continue;
+        
+        if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            recv_connection(where, c, on_event, true);
+        }
+        if (events[e].events & EPOLLOUT) {
+            c.writable = true;
+            if (c.sending() && !send_connection(where, c, on_event)) c.writable = false;
+        }
+    }
+}
+#endif
+
+#ifdef HAVE_IO_URING
+//---------------------------------
+//io_uring-based polling for the server:
+// - one multishot accept on the listen socket;
+// - one multishot receive per connection, which the kernel fills from a shared pool of provided buffers;
+// - outgoing data goes out as a chain of linked sends (one per queued buffer), so it arrives in order.
+// Requests made during a poll are submitted (along with waiting for completions) by one io_uring_enter at the start
+// of the next poll.
+
+//what each request's user_data says (the connection pointer, with the kind of request in the low bits):
+enum : uint64_t {
+    UringAccept = 1,
+    UringRecv = 2,
+    UringSend = 3,
+    UringCancel = 4,
+    UringKindMask = 7,
+};
+static const uint16_t UringBufferGroup = 0;
+
+void poll_connections_uring(
+        char const *where,
+        std::list<Connection> &connections,
+        std::function<void(Connection *, Connection::Event event)> const &on_event,
+        double timeout,
+        IoUring &ring,
+        bool &accepting,
+        Socket listen_socket) {
+    
+    auto user_data = [](Connection &c, uint64_t kind) {
+        return uint64_t(reinterpret_cast<uintptr_t>(&c)) | kind;
+    };
+    
+    auto arm_receive = [&](Connection &c) {
+        io_uring_sqe *sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = c.socket;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = UringBufferGroup;
+        sqe->user_data = user_data(c, UringRecv);
+        c.uring_requests += 1;
+        c.uring_receiving = true;
+    };
+    
+    //closing the socket doesn't stop requests already in flight (they keep the socket open), so cancel them:
+    auto cancel = [&](Connection &c, uint64_t kind) {
+        io_uring_sqe *sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = user_data(c, kind);
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = UringCancel;
+    };
+    
+    auto close_connection = [&](Connection &c) {
+        if (c.socket == InvalidSocket) return;
+        c.close();
+        if (on_event) on_event(&c, Connection::OnClose);
+    };
+    
+    if (!accepting) {
+        io_uring_sqe *sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_socket;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->user_data = UringAccept;
+        accepting = true;
+    }
+    
+    //start sending on connections that have something to send and aren't already sending:
+    const uint32_t MaxChain = 16;
+    bool sent = false;
+    for (auto &c: connections) {
+        if (c.socket == InvalidSocket) {
+            if (c.uring_requests != 0 && !c.uring_cancelled) {
+                cancel(c, UringRecv);
+                cancel(c, UringSend);
+                c.uring_cancelled = true;
+            }
+            continue;
+        }
+        if (c.uring_sends != 0 || !c.sending()) continue;
+        
+        //send_buffer's storage can't move while the kernel reads from it, so move it onto the queue:
+        if (!c.send_buffer.empty()) {
+            c.send_queue.emplace_back(std::make_shared<std::vector<uint8_t> const>(c.send_buffer.take()));
+        }
+        
+        //(a chain has to be submitted all at once, so make sure it won't get split by get_sqe submitting)
+        auto count = uint32_t(std::min<size_t>(MaxChain, c.send_queue.size()));
+        if (ring.space() < count) ring.enter(false, 0.0);
+        
+        size_t offset = c.send_queue_offset;
+        for (uint32_t i = 0; i < count; ++i) {
+            std::vector<uint8_t> const &buffer = *c.send_queue[i];
+            io_uring_sqe *sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = c.socket;
+            sqe->addr = uint64_t(reinterpret_cast<uintptr_t>(buffer.data() + offset));
+            sqe->len = uint32_t(buffer.size() - offset);
+            sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL; //(MSG_WAITALL: keep going rather than finishing short)
+            if (i + 1 < count) {
+                sqe->flags = IOSQE_IO_LINK;
+                //more is coming right behind this, so don't let Nagle send it (and then wait for an ack) by itself:
+                sqe->msg_flags |= MSG_MORE;
+            }
+            sqe->user_data = user_data(c, UringSend);
+            offset = 0;
+        }
+        c.uring_requests += count;
+        c.uring_sends = count;
+        c.uring_sent = 0;
+        sent = true;
     }
     
+    //submit everything, and wait for something to happen (unless sends just went out -- that counts as something):
+    timed_wait([&]() {
+        ring.enter(true, sent ? 0.0 : timeout);
+        return 0;
+    });
     
+    ring.for_each_cqe([&](io_uring_cqe const &cqe) {
+        uint64_t kind = cqe.user_data & UringKindMask;
+        
+        if (kind == UringAccept) {
+            if (!(cqe.flags & IORING_CQE_F_MORE)) accepting = false; //(re-armed next poll)
+            if (cqe.res < 0) return; //oh well.
+            connections.emplace_back();
+            Connection &c = connections.back();
+            c.socket = cqe.res;
+            std::cerr << "[" << where << "] client connected on " << c.socket << "." << std::endl; //INFO
+            if (on_event) on_event(&c, Connection::OnOpen);
+            if (c.socket != InvalidSocket) arm_receive(c);
+            return;
+        }
+        if (kind != UringRecv && kind != UringSend) return; //(cancels and failed buffer returns: nothing to do)
+        
+        Connection &c = *reinterpret_cast<Connection *>(uintptr_t(cqe.user_data & ~UringKindMask));
+        
+        if (kind == UringRecv) {
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                auto id = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                if (cqe.res > 0 && c.socket != InvalidSocket) {
+                    recv_byte_count += size_t(cqe.res);
+                    c.recv_buffer.append(ring.buffer(id), size_t(cqe.res));
+                    if (on_event) on_event(&c, Connection::OnRecv);
+                }
+                ring.return_buffer(id);
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                c.uring_requests -= 1;
+                c.uring_receiving = false;
+                if (cqe.res == 0) {
+                    if (c.socket != InvalidSocket) {
+                        std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
+                    }
+                    close_connection(c);
+                } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+                    if (c.socket != InvalidSocket) {
+                        std::cerr << "[" << where << "] receive returned error " << -cqe.res << "(" << strerror(-cqe.res)
+                                  << "), disconnecting." << std::endl;
+                    }
+                    close_connection(c);
+                } else if (c.socket != InvalidSocket) {
+                    //stopped for some other reason (e.g., ran out of provided buffers), so start again:
+                    arm_receive(c);
+                }
+            }
+        } else if (kind == UringSend) {
+            c.uring_requests -= 1;
+            c.uring_sends -= 1;
+            if (cqe.res > 0) {
+                c.uring_sent += size_t(cqe.res);
+            } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+                if (c.socket != InvalidSocket) {
+                    std::cerr << "[" << where << "] send returned error " << -cqe.res << ", disconnecting." << std::endl;
+                }
+                close_connection(c);
+            }
+            //whole chain done? (if part of it came up short, the rest was cancelled and goes out with the next chain)
+            if (c.uring_sends == 0) {
+                drop_sent(c, c.uring_sent);
+                c.uring_sent = 0;
+            }
+        }
+    });
 }
+#endif
 
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(std::string const &port, Backend backend_) : backend(backend_) {
 
 #ifdef _WIN32
     { //init winsock:
@@ -273,22 +678,83 @@ Server::Server(std::string const &port) {
     }
     
     { //listen on socket
-        int ret = ::listen(listen_socket, 5);
+        //(a big backlog, so a crowd of clients connecting at once doesn't get turned away)
+        int ret = ::listen(listen_socket, SOMAXCONN);
         if (ret < 0) {
             closesocket(listen_socket);
             throw std::system_error(errno, std::system_category(), "failed to listen on socket");
         }
     }
+    
+    if (backend == Backend::Epoll) {
+#ifdef __linux__
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) {
+            throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+        }
+        
+        //the listen socket is non-blocking so that accepting everything pending (as edge-triggered needs) can stop:
+        fcntl(listen_socket, F_SETFL, fcntl(listen_socket, F_GETFL, 0) | O_NONBLOCK);
+        
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = nullptr; //(connections are identified by pointer, so null means the listen socket)
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_socket, &event) != 0) {
+            throw std::system_error(errno, std::system_category(), "failed to add listen socket to epoll instance");
+        }
+#else
+        throw std::runtime_error("The epoll backend is only available on linux.");
+#endif
+    }
+    
+    if (backend == Backend::IoUring) {
+#ifdef HAVE_IO_URING
+        uring = std::make_unique<IoUring>(4096);
+        uring->setup_buffers(UringBufferGroup, 4096, 4096);
+#else
+        throw std::runtime_error("The io_uring backend is only available on linux (with io_uring headers).");
+#endif
+    }
+}
+
+Server::~Server() {
+#ifdef __linux__
+    if (epoll_fd >= 0) close(epoll_fd);
+#endif
 }
 
 void Server::poll(std::function<void(Connection *, Connection::Event event)> const &on_event, double timeout) {
-    poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+    uint64_t syscalls_before = syscall_count;
+    uint64_t recv_bytes_before = recv_byte_count;
+    uint64_t sent_bytes_before = sent_byte_count;
+    double wait_before = wait_seconds;
+#ifdef HAVE_IO_URING
+    uint64_t enters_before = (uring ? uring->enters : 0);
+    if (backend == Backend::IoUring) {
+        poll_connections_uring("Server::poll", connections, on_event, timeout, *uring, uring_accepting, listen_socket);
+    } else
+#endif
+#ifdef __linux__
+    if (backend == Backend::Epoll) {
+        poll_connections_epoll("Server::poll", connections, on_event, timeout, epoll_fd, listen_socket);
+    } else
+#endif
+    {
+        poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+    }
+    syscalls += syscall_count - syscalls_before;
+    bytes_received += recv_byte_count - recv_bytes_before;
+    bytes_sent += sent_byte_count - sent_bytes_before;
+    waited += wait_seconds - wait_before;
+#ifdef HAVE_IO_URING
+    if (uring) syscalls += uring->enters - enters_before;
+#endif
     
     //reap closed clients:
     for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
         auto old = connection;
         ++connection;
-        if (old->socket == InvalidSocket) {
+        if (old->socket == InvalidSocket && old->uring_requests == 0) { //(io_uring: wait for its requests to finish)
             connections.erase(old);
         }
     }
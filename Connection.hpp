@@ -14,7 +14,7 @@ int main(int argc, char **argv) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
 				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
+				std::vector< uint8_t > data(connection->recv_buffer.begin(), connection->recv_buffer.end());
 				connection->recv_buffer.clear();
 				//send to other connections:
 
@@ -60,8 +60,12 @@ constexpr const Socket InvalidSocket = -1;
 #endif
 //--------- ---------------------------------- ---------
 
+#include "ByteBuffer.hpp"
+
 #include <vector>
 #include <list>
+#include <deque>
+#include <memory>
 #include <string>
 #include <functional>
 #include <cstdint>
@@ -76,10 +80,16 @@ struct Connection {
     
     //Helper that will append raw bytes to the send buffer:
     void send_raw(void const *data, size_t size) {
-        send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data),
-                           reinterpret_cast< uint8_t const * >(data) + size);
+        send_buffer.append(data, size);
     }
     
+    //Append a whole buffer without copying it -- e.g., one that is being sent to many connections.
+    // (the buffer is kept alive until it has been sent, and must not be modified after this)
+    void send_shared(std::shared_ptr<std::vector<uint8_t> const> const &buffer);
+    
+    //true if there is anything waiting to be sent (in send_queue or send_buffer):
+    bool sending() const { return !send_queue.empty() || !send_buffer.empty(); }
+    
     template<typename T>
     void recv(size_t index, T &t) {
         auto const *ptr = reinterpret_cast<T const *>(&recv_buffer[index]);
@@ -93,12 +103,23 @@ struct Connection {
     explicit operator bool() const { return socket != InvalidSocket; }
     
     //To send data over a connection, append it to send_buffer:
-    std::vector<uint8_t> send_buffer;
-    //When the connection receives data, it is appended to recv_buffer:
-    std::vector<uint8_t> recv_buffer;
+    ByteBuffer send_buffer;
+    //Buffers passed to send_shared() (and whatever was in send_buffer before them) wait here, and go out before send_buffer:
+    std::deque<std::shared_ptr<std::vector<uint8_t> const>> send_queue;
+    size_t send_queue_offset = 0; //bytes of send_queue.front() already sent
+    //When the connection receives data, it is appended to recv_buffer (consume() it from the front once handled):
+    ByteBuffer recv_buffer;
     
     //internals:
     Socket socket = InvalidSocket;
+    bool writable = true; //(epoll backend) false after the socket filled up, until epoll says it has room again
+    
+    //(io_uring backend) requests the kernel still has in flight for this connection -- it can't be freed until they finish:
+    uint32_t uring_requests = 0;
+    bool uring_receiving = false; //a multishot receive is armed
+    bool uring_cancelled = false; //closed, and its requests have been asked to stop
+    uint32_t uring_sends = 0; //sends in the current (linked) chain that haven't completed
+    size_t uring_sent = 0; //bytes the current chain has sent so far
     
     enum Event {
         OnOpen,
@@ -107,8 +128,24 @@ struct Connection {
     };
 };
 
+struct IoUring;
+
 struct Server {
-    explicit Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+    //how poll() waits for sockets:
+    enum class Backend {
+        Select, //select(): works everywhere, but costs O(connections) per poll and is limited to FD_SETSIZE (usually 1024) sockets
+        Epoll, //epoll (linux only): sockets are registered once, and a poll only looks at the ones with something happening
+        IoUring, //io_uring (linux only, 6.0+): all socket work for a poll is batched into (about) one syscall
+    };
+#ifdef __linux__
+    inline static constexpr Backend DefaultBackend = Backend::Epoll;
+#else
+    inline static constexpr Backend DefaultBackend = Backend::Select;
+#endif
+    
+    //pass the port number to listen on, as a string (servname, really):
+    explicit Server(std::string const &port, Backend backend = DefaultBackend);
+    ~Server();
     
     //poll() updates the list of active connections and sends/receives data if possible:
     // (will wait up to 'timeout' for first event)
@@ -117,8 +154,18 @@ struct Server {
             double timeout = 0.0 //timeout (seconds)
     );
     
-    std::list<Connection> connections;
+    std::list<Connection> connections; //(a list, so the epoll and io_uring backends can keep pointers to connections)
     Socket listen_socket = InvalidSocket;
+    
+    Backend backend;
+    int epoll_fd = -1; //(epoll backend) the epoll instance every socket is registered with
+    std::unique_ptr<IoUring> uring; //(io_uring backend) the ring all socket requests go through
+    bool uring_accepting = false; //(io_uring backend) a multishot accept is armed
+    
+    uint64_t syscalls = 0; //socket-related syscalls made by poll() so far (for benchmarking)
+    uint64_t bytes_received = 0; //bytes poll() has read from sockets so far (for profiling)
+    uint64_t bytes_sent = 0; //bytes poll() has written to sockets so far (for profiling)
+    double waited = 0.0; //seconds poll() has spent blocked waiting for sockets so far (for profiling)
 };
 
 
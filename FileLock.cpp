@@ -0,0 +1,61 @@
+#include "FileLock.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#endif
+
+#ifdef _WIN32
+
+FileLock::FileLock(std::string const &filename) {
+    file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                       OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        throw std::runtime_error("Failed to open lock file '" + filename + "'.");
+    }
+    OVERLAPPED overlapped = {};
+    if (!LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped)) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to lock '" + filename + "'.");
+    }
+}
+
+FileLock::~FileLock() {
+    OVERLAPPED overlapped = {};
+    UnlockFileEx(file, 0, 1, 0, &overlapped);
+    CloseHandle(file);
+}
+
+#else //posix
+
+FileLock::FileLock(std::string const &filename) {
+    fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open lock file '" + filename + "': " + std::strerror(errno));
+    }
+    int ret;
+    do {
+        ret = flock(fd, LOCK_EX);
+    } while (ret != 0 && errno == EINTR);
+    if (ret != 0) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Failed to lock '" + filename + "': " + std::strerror(error));
+    }
+}
+
+FileLock::~FileLock() {
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+ * FileLock is an exclusive lock shared between processes, held for as long
+ * as the object exists:
+ *
+ *  {
+ *      FileLock lock("world.w.baked.lock"); //waits for any other process holding it; throws if the file can't be made
+ *      ... only one process at a time gets here ...
+ *  }
+ *
+ * The lock file itself is left behind (removing it would race with the next
+ * process to open it); the lock goes away with the process, even if it crashes.
+ */
+
+#include <string>
+
+struct FileLock {
+    explicit FileLock(std::string const &filename);
+    ~FileLock();
+
+    FileLock(FileLock const &) = delete;
+    FileLock &operator=(FileLock const &) = delete;
+
+    //internals:
+#ifdef _WIN32
+    void *file = nullptr; //(HANDLE)
+#else
+    int fd = -1;
+#endif
+};
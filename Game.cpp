@@ -4,11 +4,16 @@
 #include "data_path.hpp"
 #include "Load.hpp"
 #include "WalkMesh.hpp"
+#include "WorkerPool.hpp"
+#include "Profiler.hpp"
 
 #include <stdexcept>
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <ctime>
+#include <cmath>
+#include <optional>
 
 #include <glm/gtx/norm.hpp>
 
@@ -76,46 +81,144 @@ bool Player::Controls::recv_controls_message(Connection *connection_) {
     }
     
     //delete message from buffer:
-    recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + 4 + size);
+    recv_buffer.consume(4 + size);
     
     return true;
 }
 
 
+//-----------------------------------------
+
+void Players::clear() {
+    controls.clear();
+    id.clear();
+    at.clear();
+    rotation.clear();
+    name.clear();
+    position.clear();
+    step.clear();
+    
+    //all outstanding handles become invalid:
+    for (uint32_t slot = 0; slot < slot_index.size(); ++slot) {
+        if (slot_index[slot] != -1U) {
+            slot_index[slot] = -1U;
+            slot_generation[slot] += 1;
+            free_slots.emplace_back(slot);
+        }
+    }
+    index_slot.clear();
+}
+
+Player::Handle Players::push_back() {
+    uint32_t index = uint32_t(size());
+    
+    controls.emplace_back();
+    id.emplace_back(0);
+    at.emplace_back();
+    rotation.emplace_back();
+    name.emplace_back();
+    position.emplace_back(0.0f);
+    step.emplace_back(0.0f);
+    
+    Player::Handle handle;
+    if (!free_slots.empty()) {
+        handle.slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        handle.slot = uint32_t(slot_index.size());
+        slot_index.emplace_back(-1U);
+        slot_generation.emplace_back(0);
+    }
+    handle.generation = slot_generation[handle.slot];
+    slot_index[handle.slot] = index;
+    index_slot.emplace_back(handle.slot);
+    
+    return handle;
+}
+
+void Players::erase(Player::Handle handle) {
+    uint32_t index = this->index(handle);
+    uint32_t last = uint32_t(size()) - 1;
+    
+    //move the last player into the hole:
+    if (index != last) {
+        controls[index] = controls[last];
+        id[index] = id[last];
+        at[index] = at[last];
+        rotation[index] = rotation[last];
+        name[index] = std::move(name[last]);
+        position[index] = position[last];
+        step[index] = step[last];
+        
+        index_slot[index] = index_slot[last];
+        slot_index[index_slot[index]] = index;
+    }
+    controls.pop_back();
+    id.pop_back();
+    at.pop_back();
+    rotation.pop_back();
+    name.pop_back();
+    position.pop_back();
+    step.pop_back();
+    index_slot.pop_back();
+    
+    //free the slot (bumping the generation so stale handles don't match):
+    slot_index[handle.slot] = -1U;
+    slot_generation[handle.slot] += 1;
+    free_slots.emplace_back(handle.slot);
+}
+
+uint32_t Players::index(Player::Handle handle) const {
+    assert(valid(handle) && "invalid player handle");
+    return slot_index[handle.slot];
+}
+
+void Sheeps::resize(size_t count) {
+    at.resize(count);
+    rotation.resize(count);
+    bias.resize(count, glm::vec3(0.0f));
+    rng.resize(count);
+    position.resize(count, glm::vec3(0.0f));
+    step.resize(count, glm::vec3(0.0f));
+}
+
 //-----------------------------------------
 
 // moved this out of a load that would have to be in a header to avoid linker errors
 WalkMeshes const *world_walkmeshes = nullptr;
 
-Game::Game() : mt((unsigned int) std::time(nullptr)) {
-    // clang-tidy doesn't like how i initialize the rng, interesting
+void load_world_walkmeshes(std::string const &baked) {
+    assert(world_walkmeshes == nullptr && "world walkmeshes already loaded");
+    // (by way of a baked copy, which is mapped rather than loaded and built -- see WalkMeshes::load_cached)
+    world_walkmeshes = new WalkMeshes(WalkMeshes::load_cached(data_path("world.w"), baked));
+}
+
+Game::Game(size_t sheep_count, uint32_t seed) : mt(seed) {
     if (world_walkmeshes == nullptr) {
-        world_walkmeshes = new WalkMeshes(data_path("world.w"));
+        load_world_walkmeshes();
     }
     
     walkmesh = &world_walkmeshes->lookup("WalkMesh");
     assert(walkmesh && "walkmesh not initialized");
     
-    for (glm::vec3 vertex: walkmesh->vertices) {
-        min_bound = glm::min(min_bound, vertex);
-        max_bound = glm::max(max_bound, vertex);
-    }
+    // (the bvh's root already has the bounds of every triangle, so there's no need to look at every vertex)
+    min_bound = glm::min(min_bound, walkmesh->bvh[0].min);
+    max_bound = glm::max(max_bound, walkmesh->bvh[0].max);
     
-    for (size_t i = 0; i < SheepCount; i++) {
-        sheeps.emplace_back();
-        Sheep &sheep = sheeps.back();
-        
-        sheep.at = walkmesh->nearest_walk_point(random_coordinates());
-        sheep.rotation =
+    sheeps.resize(sheep_count);
+    for (size_t i = 0; i < sheep_count; i++) {
+        sheeps.at[i] = walkmesh->nearest_walk_point(random_coordinates());
+        sheeps.rotation[i] =
                 glm::rotation(
                         glm::vec3(0.0f, 0.0f, 1.0f),
-                        walkmesh->to_world_smooth_normal(sheep.at)
+                        walkmesh->to_world_smooth_normal(sheeps.at[i])
                 )
                 *
                 glm::angleAxis(
                         2 * glm::pi<float>() * float(mt()) / float(std::mt19937::max()),
                         glm::vec3(0.0f, 0.0f, 1.0f)
                 );
+        sheeps.rng[i] = Rng((uint64_t(mt()) << 32) | uint64_t(i));
     }
 }
 
@@ -127,253 +230,484 @@ glm::vec3 Game::random_coordinates() {
     };
 }
 
-Player *Game::spawn_player() {
-    players.emplace_back();
-    Player &player = players.back();
+glm::vec3 Game::random_coordinates(Rng &rng) const {
+    return {
+            rng.unit() * (max_bound.x - min_bound.x) + min_bound.x,
+            rng.unit() * (max_bound.y - min_bound.y) + min_bound.y,
+            rng.unit() * (max_bound.z - min_bound.z) + min_bound.z
+    };
+}
+
+Player::Handle Game::spawn_player() {
+    Player::Handle handle = players.push_back();
+    uint32_t index = players.index(handle);
     
-    player.at = walkmesh->nearest_walk_point(random_coordinates());
-    player.rotation =
+    WalkPoint &at = players.at[index];
+    at = walkmesh->nearest_walk_point(random_coordinates());
+    players.rotation[index] =
             glm::rotation(
                     glm::vec3(0.0f, 0.0f, 1.0f),
-                    walkmesh->to_world_smooth_normal(player.at)
+                    walkmesh->to_world_smooth_normal(at)
             )
             *
             glm::angleAxis(
                     2 * glm::pi<float>() * float(mt()) / float(std::mt19937::max()),
                     glm::vec3(0.0f, 0.0f, 1.0f)
             );
+    players.position[index] = walkmesh->to_world_point(at);
     
-    player.name = "ClientPlayer " + std::to_string(next_player_number++);
+    players.id[index] = next_player_number;
+    players.name[index] = "ClientPlayer " + std::to_string(next_player_number);
+    next_player_number += 1;
     
-    return &player;
+    return handle;
 }
 
-void Game::remove_player(Player *player) {
-    bool found = false;
-    for (auto pi = players.begin(); pi != players.end(); ++pi) {
-        if (&*pi == player) {
-            players.erase(pi);
-            found = true;
-            break;
-        }
-    }
-    assert(found);
+void Game::remove_player(Player::Handle player) {
+    assert(players.valid(player));
+    players.erase(player);
 }
 
-// a bit scuffed to have the walkmesh as the first argument but can't be bothered
-void update_position(const WalkMesh *walkmesh, WalkPoint &at, glm::vec3 remain) {
-    for (size_t i = 0; i < 10; i++) {
-        if (remain == glm::vec3(0.0f, 0.0f, 0.0f)) {
-            break;
-        }
-        WalkPoint end;
-        float time;
-        
-        walkmesh->walk_in_triangle(at, remain, &end, &time);
-        at = end;
-        if (time == 1.0f) {
-            remain = glm::vec3(0.0f, 0.0f, 0.0f);
-            break;
-        }
-        remain *= (1.0f - time);
-        glm::quat rotation;
-        if (walkmesh->cross_edge(at, &end, &rotation)) {
-            at = end;
-            remain = rotation * remain;
-        } else {
-            glm::vec3 const &a = walkmesh->vertices[at.indices.x];
-            glm::vec3 const &b = walkmesh->vertices[at.indices.y];
-            glm::vec3 const &c = walkmesh->vertices[at.indices.z];
-            glm::vec3 along = glm::normalize(b - a);
-            glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
-            glm::vec3 in = glm::cross(normal, along);
-            
-            // check how much 'remain' is pointing out of the triangle:
-            float d = glm::dot(remain, in);
-            if (d < 0.0f) {
-                // bounce off of the wall:
-                remain += (-1.25f * d) * in;
-            } else {
-                // if it's just pointing along the edge, bend slightly away from wall:
-                remain += 0.01f * d * in;
-            }
-        }
-    }
-    
-    if (remain != glm::vec3(0.0f)) {
-        std::cout << "NOTE: code used full iteration budget for walking." << std::endl;
-    }
+// after walking, turn to match the walkmesh's (smoothed) up direction where 'at' ended up:
+static void align_to_walkmesh(WalkMesh const *walkmesh, WalkPoint const &at, glm::quat &rotation) {
+    glm::quat adjust = glm::rotation(
+            rotation * glm::vec3(0.0f, 0.0f, 1.0f), //current up vector
+            walkmesh->to_world_smooth_normal(at) //smoothed up vector at walk location
+    );
+    rotation = glm::normalize(adjust * rotation);
 }
 
 void Game::update(float elapsed) {
+    std::optional<Profiler::Scope> phase;
+    phase.emplace(profiler, Profiler::Players);
+    
     //position/velocity update:
-    for (auto &player: players) {
+    for (size_t i = 0; i < players.size(); ++i) {
+        Player::Controls &controls = players.controls[i];
+        WalkPoint &at = players.at[i];
+        glm::quat &rotation = players.rotation[i];
+        
         // update the rotation according to the input (this is only the yaw, since pitch is handled by the client)
         {
             // TODO: the game5 base code uses player.camera->fovy, maybe want to use that instead somehow
-            player.rotation = glm::angleAxis(
-                    -MouseSpeed * player.controls.mousex,
-                    walkmesh->to_world_smooth_normal(player.at)
-            ) * player.rotation;
+            rotation = glm::angleAxis(
+                    -MouseSpeed * controls.mousex,
+                    walkmesh->to_world_smooth_normal(at)
+            ) * rotation;
         }
         
         // update the walkpoint
         // part paraphrased, part copied, from game5 base code:
         glm::vec3 move = glm::vec3(0.0f, 0.0f, 0.0f);
-        if (player.controls.left.pressed) move.x -= 1.0f;
-        if (player.controls.right.pressed) move.x += 1.0f;
-        if (player.controls.down.pressed) move.y -= 1.0f;
-        if (player.controls.up.pressed) move.y += 1.0f;
+        if (controls.left.pressed) move.x -= 1.0f;
+        if (controls.right.pressed) move.x += 1.0f;
+        if (controls.down.pressed) move.y -= 1.0f;
+        if (controls.up.pressed) move.y += 1.0f;
         
         if (glm::length(move) > 0) {
             move = glm::normalize(move) * PlayerSpeed * elapsed;
         }
         
-        glm::vec3 remain = player.rotation * move;
-        
-        update_position(walkmesh, player.at, remain);
-        
-        // game5 code updates transform position here, we don't to that
-        // since the client will update position based on sent walkpoints
-        
-        // update the rotation due to moving across triangles, this has to sent
-        {
-            glm::quat adjust = glm::rotation(
-                    player.rotation * glm::vec3(0.0f, 0.0f, 1.0f), //current up vector
-                    walkmesh->to_world_smooth_normal(player.at) //smoothed up vector at walk location
-            );
-            player.rotation = glm::normalize(adjust * player.rotation);
-        }
+        players.step[i] = rotation * move;
         
         //reset 'downs' since controls have been handled:
-        player.controls.left.downs = 0;
-        player.controls.right.downs = 0;
-        player.controls.up.downs = 0;
-        player.controls.down.downs = 0;
-        player.controls.mousex = 0;
+        controls.left.downs = 0;
+        controls.right.downs = 0;
+        controls.up.downs = 0;
+        controls.down.downs = 0;
+        controls.mousex = 0;
+    }
+    
+    // walk everyone at once:
+    walkmesh->walk_many(players.at.data(), players.step.data(), players.size());
+    
+    // game5 code updates transform position here, we don't to that
+    // since the client will update position based on sent walkpoints
+    
+    // update the rotation due to moving across triangles, this has to sent
+    for (size_t i = 0; i < players.size(); ++i) {
+        align_to_walkmesh(walkmesh, players.at[i], players.rotation[i]);
+    }
+    
+    phase.emplace(profiler, Profiler::Sheep);
+    
+    // cache world positions and re-bucket them for the neighbor queries below:
+    for (size_t i = 0; i < players.size(); ++i) {
+        players.position[i] = walkmesh->to_world_point(players.at[i]);
+    }
+    for (size_t i = 0; i < sheeps.size(); ++i) {
+        sheeps.position[i] = walkmesh->to_world_point(sheeps.at[i]);
+    }
+    if (use_spatial_hash) {
+        player_grid.build(players.position);
+        sheep_grid.build(sheeps.position);
     }
     
     // sheep motion: sheep move away from close players and very close sheep, and towards a randomized bias
-    for (auto &sheep: sheeps) {
-        if (mt() % 60 == 0) {
-            do {
-                sheep.bias = random_coordinates() - walkmesh->to_world_point(sheep.at);
-            } while (glm::length(sheep.bias) < 0.1f);
-            sheep.bias = glm::normalize(sheep.bias);
+    if (use_spatial_hash) {
+        // (sheep only see each other's cached positions, so a range of them can all decide and then all walk at once)
+        auto update_sheeps = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                update_sheep(i, elapsed);
+            }
+            walkmesh->walk_many(sheeps.at.data() + begin, sheeps.step.data() + begin, end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                align_to_walkmesh(walkmesh, sheeps.at[i], sheeps.rotation[i]);
+            }
+        };
+        if (workers) {
+            workers->parallel_for(sheeps.size(), update_sheeps);
+        } else {
+            update_sheeps(0, sheeps.size());
         }
-        
-        // start with bias
-        glm::vec3 desired = sheep.bias;
-        
+    } else {
+        // (the all-pairs loop reads other sheeps' walkpoints as they move, so it can only run serially)
+        for (size_t i = 0; i < sheeps.size(); ++i) {
+            update_sheep(i, elapsed);
+            walkmesh->walk(&sheeps.at[i], sheeps.step[i]);
+            align_to_walkmesh(walkmesh, sheeps.at[i], sheeps.rotation[i]);
+        }
+    }
+    
+    phase.emplace(profiler, Profiler::Encode);
+    
+    record_snapshot();
+}
+
+void Game::update_sheep(size_t i, float elapsed) {
+    WalkPoint &at = sheeps.at[i];
+    glm::quat &rotation = sheeps.rotation[i];
+    glm::vec3 &bias = sheeps.bias[i];
+    glm::vec3 &step = sheeps.step[i];
+    // (this sheep hasn't moved yet, so its cached position is still current)
+    glm::vec3 const &sheep_position = sheeps.position[i];
+    
+    Rng &rng = sheeps.rng[i];
+    if (rng() % 60 == 0) {
+        do {
+            bias = random_coordinates(rng) - sheep_position;
+        } while (glm::length(bias) < 0.1f);
+        bias = glm::normalize(bias);
+    }
+    
+    // start with bias
+    glm::vec3 desired = bias;
+    
+    if (use_spatial_hash) {
         // add things by inverse square law
-        for (auto &player: players) {
-            glm::vec3 v = walkmesh->to_world_point(player.at) - walkmesh->to_world_point(sheep.at);
+        // (neighbors are as of the start of this update, even if they've moved since)
+        player_grid.for_each_near(sheep_position, [&](uint32_t, glm::vec3 const &position) {
+            glm::vec3 v = position - sheep_position;
             // ignore things too close to make a reasonable speed or too far to care about
             if (0.01f < glm::length(v) && glm::length(v) < SheepDetectPlayerRadius) {
                 desired -= SheepAvoidPlayerConstant * glm::normalize(v) / glm::length2(v);
             }
-        }
+        });
         
-        for (auto &other: sheeps) {
+        sheep_grid.for_each_near(sheep_position, [&](uint32_t, glm::vec3 const &position) {
             // ignore things too close to make a reasonable speed or too far to care about
             // (in this case "things too close" includes the sheep itself)
-            glm::vec3 v = walkmesh->to_world_point(other.at) - walkmesh->to_world_point(sheep.at);
+            glm::vec3 v = position - sheep_position;
             if (0.01f < glm::length(v) && glm::length(v) < SheepDetectSheepRadius) {
                 desired -= SheepAvoidSheepConstant * glm::normalize(v) / glm::length2(v);
             }
+        });
+    } else {
+        // add things by inverse square law
+        for (auto const &player_at: players.at) {
+            glm::vec3 v = walkmesh->to_world_point(player_at) - walkmesh->to_world_point(at);
+            // ignore things too close to make a reasonable speed or too far to care about
+            if (0.01f < glm::length(v) && glm::length(v) < SheepDetectPlayerRadius) {
+                desired -= SheepAvoidPlayerConstant * glm::normalize(v) / glm::length2(v);
+            }
         }
         
-        // project the desired onto the plane, x points forward
-        desired = glm::inverse(sheep.rotation) * desired;
-        desired.z = 0.0f;
-        
-        // try to rotate towards the right direction
-        // (using a really cheap estimate for angle)
-        float turn_amount = 0.05f;
-        if (desired.x > 0.0f && glm::abs(glm::normalize(desired).y) < 0.4f) {
-            turn_amount = 0.025f * glm::abs(glm::normalize(desired).y);
-        }
-        if (glm::abs(glm::normalize(desired).y) < 0.1f) {
-            turn_amount = 0.0f;
+        for (auto const &other_at: sheeps.at) {
+            // ignore things too close to make a reasonable speed or too far to care about
+            // (in this case "things too close" includes the sheep itself)
+            glm::vec3 v = walkmesh->to_world_point(other_at) - walkmesh->to_world_point(at);
+            if (0.01f < glm::length(v) && glm::length(v) < SheepDetectSheepRadius) {
+                desired -= SheepAvoidSheepConstant * glm::normalize(v) / glm::length2(v);
+            }
         }
-        if (desired.y < 0.0f) {
-            // rotate clockwise
-            sheep.rotation = glm::angleAxis(
-                    -MouseSpeed * turn_amount,
-                    walkmesh->to_world_smooth_normal(sheep.at)
-            ) * sheep.rotation;
+    }
+    
+    // project the desired onto the plane, x points forward
+    desired = glm::inverse(rotation) * desired;
+    desired.z = 0.0f;
+    
+    // try to rotate towards the right direction
+    // (using a really cheap estimate for angle)
+    float turn_amount = 0.05f;
+    if (desired.x > 0.0f && glm::abs(glm::normalize(desired).y) < 0.4f) {
+        turn_amount = 0.025f * glm::abs(glm::normalize(desired).y);
+    }
+    if (glm::abs(glm::normalize(desired).y) < 0.1f) {
+        turn_amount = 0.0f;
+    }
+    if (desired.y < 0.0f) {
+        // rotate clockwise
+        rotation = glm::angleAxis(
+                -MouseSpeed * turn_amount,
+                walkmesh->to_world_smooth_normal(at)
+        ) * rotation;
+    } else {
+        // rotate counterclockwise
+        rotation = glm::angleAxis(
+                MouseSpeed * turn_amount,
+                walkmesh->to_world_smooth_normal(at)
+        ) * rotation;
+    }
+    
+    // now try to move (sheep can only move forwards)
+    // (the actual walking happens in update, along with the other sheep)
+    desired.y = 0.0f;
+    step = glm::vec3(0.0f);
+    if (desired.x > 0.0f) {
+        desired.x = glm::min(desired.x, SheepSpeed) * elapsed;
+        step = rotation * desired;
+    }
+}
+
+void Game::record_snapshot() {
+    auto snapshot = std::make_shared<Snapshot>();
+    tick += 1;
+    snapshot->id = tick;
+    
+    snapshot->player_id = players.id;
+    snapshot->player_at = players.at;
+    snapshot->player_rotation = players.rotation;
+    snapshot->player_name = players.name;
+    
+    snapshot->sheep_at = sheeps.at;
+    snapshot->sheep_rotation = sheeps.rotation;
+    
+    snapshots.emplace_back(std::move(snapshot));
+    while (snapshots.size() > SnapshotHistory) {
+        snapshots.pop_front();
+    }
+}
+
+std::shared_ptr<Snapshot const> Game::find_snapshot(uint32_t id) const {
+    if (id == 0) return nullptr;
+    //ids are consecutive on the server, but the client may have skipped some, so search (from the newest):
+    for (auto si = snapshots.rbegin(); si != snapshots.rend(); ++si) {
+        if ((*si)->id == id) return *si;
+        if ((*si)->id < id) break;
+    }
+    return nullptr;
+}
+
+//flags sent with each player in a state message:
+enum : uint8_t {
+    PlayerMoved = 0x01, // at and rotation follow (otherwise: same as in the baseline)
+    PlayerNamed = 0x02, // name follows (otherwise: same as in the baseline)
+};
+
+//"smallest three" quaternion compression: drop the largest component (it can be recovered from the other three, since
+// the quaternion is unit length, and its sign doesn't matter since q and -q are the same rotation), and send the rest
+// with 10 bits each -- they are all in [-1/sqrt(2), 1/sqrt(2)] -- along with 2 bits saying which one was dropped:
+static uint32_t pack_rotation(glm::quat q) {
+    q = glm::normalize(q);
+    uint32_t largest = 0;
+    for (uint32_t i = 1; i < 4; ++i) {
+        if (std::abs(q[i]) > std::abs(q[largest])) largest = i;
+    }
+    float sign = (q[largest] < 0.0f ? -1.0f : 1.0f);
+    
+    uint32_t bits = largest;
+    for (uint32_t i = 0; i < 4; ++i) {
+        if (i == largest) continue;
+        float v = sign * q[i] * 0.70710678f + 0.5f; //[-1/sqrt(2), 1/sqrt(2)] -> [0,1]
+        bits = (bits << 10) | uint32_t(std::round(std::min(std::max(v, 0.0f), 1.0f) * 1023.0f));
+    }
+    return bits;
+}
+
+static glm::quat unpack_rotation(uint32_t bits) {
+    uint32_t largest = bits >> 30;
+    glm::quat q;
+    float sum = 0.0f;
+    for (uint32_t i = 4; i > 0; --i) {
+        if (i - 1 == largest) continue;
+        float v = (float(bits & 1023U) / 1023.0f - 0.5f) * 1.41421356f;
+        bits >>= 10;
+        q[i - 1] = v;
+        sum += v * v;
+    }
+    q[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+    return glm::normalize(q);
+}
+
+void Game::encode_state(std::vector<uint8_t> &out, Snapshot const *baseline, uint8_t version, uint32_t first_id) const {
+    assert(!snapshots.empty() && "need to record a snapshot before sending one");
+    Snapshot const &current = *snapshots.back();
+    
+    //append bytes to out:
+    auto put_raw = [&](void const *data, size_t bytes) {
+        out.insert(out.end(), reinterpret_cast<uint8_t const *>(data), reinterpret_cast<uint8_t const *>(data) + bytes);
+    };
+    auto put = [&](auto const &val) {
+        put_raw(&val, sizeof(val));
+    };
+    
+    //send a position and rotation, in whichever form this version uses:
+    auto put_at_rotation = [&](WalkPoint const &at, glm::quat const &rotation) {
+        if (version == 0) {
+            //(just indices and weights -- 'triangle' isn't part of this format)
+            put(at.indices);
+            put(at.weights);
+            put(rotation);
         } else {
-            // rotate counterclockwise
-            sheep.rotation = glm::angleAxis(
-                    MouseSpeed * turn_amount,
-                    walkmesh->to_world_smooth_normal(sheep.at)
-            ) * sheep.rotation;
+            put(walkmesh->pack(at));
+            put(pack_rotation(rotation));
+        }
+    };
+    
+    //(most everything changes most ticks, so reserve for sending everything)
+    size_t entity_bytes = (version == 0 ? sizeof(glm::uvec3) + sizeof(glm::vec3) + sizeof(glm::quat)
+                                        : sizeof(PackedWalkPoint) + sizeof(uint32_t));
+    out.reserve(out.size() + 4 + 4 + 1 + current.player_id.size() * (4 + 1 + entity_bytes + 16)
+                + 4 + (current.sheep_at.size() + 7) / 8 + current.sheep_at.size() * entity_bytes);
+    
+    put(current.id);
+    put(uint32_t(baseline ? baseline->id : 0));
+    
+    //before version 3, a client can only be told about LegacyMaxPlayers players, and which ones it was told about
+    // in the baseline isn't known here -- so when some are left out, every player sent is sent in full:
+    bool truncated = (version < 3 && current.player_id.size() > LegacyMaxPlayers);
+    
+    //send player info helper:
+    auto put_player = [&](size_t i) {
+        //find this player in the baseline (there aren't many players, so just search):
+        size_t b = size_t(-1);
+        if (baseline && !truncated) {
+            auto f = std::find(baseline->player_id.begin(), baseline->player_id.end(), current.player_id[i]);
+            if (f != baseline->player_id.end()) b = f - baseline->player_id.begin();
         }
         
-        // now try to move (sheep can only move forwards)
-        desired.y = 0.0f;
-        if (desired.x > 0.0f) {
-            desired.x = glm::min(desired.x, SheepSpeed) * elapsed;
-            glm::vec3 remain = sheep.rotation * desired;
-            
-            update_position(walkmesh, sheep.at, remain);
+        uint8_t flags = 0;
+        if (b == size_t(-1)) {
+            flags = PlayerMoved | PlayerNamed;
+        } else if (std::memcmp(&current.player_at[i], &baseline->player_at[b], sizeof(WalkPoint)) != 0
+                   || std::memcmp(&current.player_rotation[i], &baseline->player_rotation[b], sizeof(glm::quat)) != 0) {
+            flags = PlayerMoved;
         }
         
-        // update the rotation due to moving across triangles, this has to sent
-        {
-            glm::quat adjust = glm::rotation(
-                    sheep.rotation * glm::vec3(0.0f, 0.0f, 1.0f), //current up vector
-                    walkmesh->to_world_smooth_normal(sheep.at) //smoothed up vector at walk location
-            );
-            sheep.rotation = glm::normalize(adjust * sheep.rotation);
+        put(current.player_id[i]);
+        put(flags);
+        if (flags & PlayerMoved) {
+            put_at_rotation(current.player_at[i], current.player_rotation[i]);
+        }
+        if (flags & PlayerNamed) {
+            //NOTE: can't just 'send(name)' because player.name is not plain-old-data type.
+            //effectively: truncates player name to 255 chars
+            std::string const &name = current.player_name[i];
+            uint8_t len = uint8_t(std::min<size_t>(255, name.size()));
+            put(len);
+            put_raw(name.data(), len);
+        }
+    };
+    
+    //player count (a byte before version 3, so older clients hear about no more players than that can count):
+    size_t player_count = current.player_id.size();
+    if (version < 3) {
+        player_count = std::min(player_count, LegacyMaxPlayers);
+        put(uint8_t(player_count));
+    } else {
+        put(uint32_t(player_count));
+    }
+    size_t first = size_t(-1);
+    if (first_id != 0) {
+        auto f = std::find(current.player_id.begin(), current.player_id.end(), first_id);
+        if (f != current.player_id.end()) first = f - current.player_id.begin();
+    }
+    size_t put_count = 0;
+    if (first != size_t(-1)) {
+        put_player(first);
+        put_count += 1;
+    }
+    for (size_t i = 0; i < current.player_id.size() && put_count < player_count; ++i) {
+        if (i == first) continue;
+        put_player(i);
+        put_count += 1;
+    }
+    
+    //sheep count, then one bit per sheep saying whether it changed, then the walkpoints and rotations of the ones that did:
+    auto sheep_count = uint32_t(current.sheep_at.size());
+    put(sheep_count);
+    
+    size_t bits_mark = out.size();
+    out.resize(bits_mark + (sheep_count + 7) / 8, 0);
+    for (uint32_t i = 0; i < sheep_count; ++i) {
+        if (baseline && i < baseline->sheep_at.size()
+            && std::memcmp(&current.sheep_at[i], &baseline->sheep_at[i], sizeof(WalkPoint)) == 0
+            && std::memcmp(&current.sheep_rotation[i], &baseline->sheep_rotation[i], sizeof(glm::quat)) == 0) {
+            continue;
         }
+        out[bits_mark + i / 8] |= uint8_t(1 << (i % 8));
+        put_at_rotation(current.sheep_at[i], current.sheep_rotation[i]);
     }
 }
 
+std::shared_ptr<std::vector<uint8_t> const> Game::shared_state(uint32_t baseline_id, uint8_t version) const {
+    assert(!snapshots.empty() && "need to record a snapshot before sending one");
+    std::shared_ptr<Snapshot const> baseline = find_snapshot(baseline_id);
+    baseline_id = (baseline ? baseline->id : 0);
+    
+    //encodings are only good for the tick they were made on:
+    if (shared_tick != tick) {
+        shared.clear();
+        shared_tick = tick;
+    }
+    for (auto const &s: shared) {
+        if (s.baseline == baseline_id && s.version == version) return s.body;
+    }
+    
+    auto body = std::make_shared<std::vector<uint8_t>>();
+    encode_state(*body, baseline.get(), version);
+    shared.emplace_back(SharedState{baseline_id, version, body});
+    return body;
+}
 
-void Game::send_state_message(Connection *connection_, Player *connection_player) const {
+void Game::send_state_message(Connection *connection_, Player::Handle connection_player, uint32_t baseline_id,
+                              uint8_t version) const {
     assert(connection_);
     auto &connection = *connection_;
     
-    connection.send(Message::S2C_State);
-    //will patch message size in later, for now placeholder bytes:
-    connection.send(uint8_t(0));
-    connection.send(uint8_t(0));
-    connection.send(uint8_t(0));
-    size_t mark = connection.send_buffer.size(); //keep track of this position in the buffer
-    
+    assert(version <= ProtocolVersion);
+    uint32_t you = (players.valid(connection_player) ? players.id[players.index(connection_player)] : 0);
     
-    //send player info helper:
-    auto send_player = [&](Player const &player) {
-        connection.send(player.at);
-        connection.send(player.rotation);
+    //(a version 2 encoding with more players than it can count would leave some clients out, so those get their own)
+    bool shareable = (version >= 3 || (version == 2 && snapshots.back()->player_id.size() <= LegacyMaxPlayers));
+    if (shareable) {
+        //the body is the same for every client with the same baseline, so it is encoded once and shared;
+        // all that's per-client is the header saying which player is theirs:
+        std::shared_ptr<std::vector<uint8_t> const> body = shared_state(baseline_id, version);
         
-        //NOTE: can't just 'send(name)' because player.name is not plain-old-data type.
-        //effectively: truncates player name to 255 chars
-        uint8_t len = uint8_t(std::min<size_t>(255, player.name.size()));
-        connection.send(len);
-        connection.send_buffer.insert(connection.send_buffer.end(), player.name.begin(), player.name.begin() + len);
-    };
-    
-    //player count:
-    connection.send(uint8_t(players.size()));
-    if (connection_player) send_player(*connection_player);
-    for (auto const &player: players) {
-        if (&player == connection_player) continue;
-        send_player(player);
+        auto size = uint32_t(1 + 4 + body->size());
+        connection.send(Message::S2C_VersionedState);
+        connection.send(uint8_t(size));
+        connection.send(uint8_t(size >> 8));
+        connection.send(uint8_t(size >> 16));
+        connection.send(version);
+        connection.send(you);
+        connection.send_shared(body);
+        return;
     }
     
-    connection.send(uint8_t(sheeps.size()));
-    for (auto const &sheep: sheeps) {
-        connection.send(sheep.at);
-        connection.send(sheep.rotation);
-    }
+    //older versions have this client's player first in the list, so get their own encoding:
+    auto body = std::make_shared<std::vector<uint8_t>>();
+    encode_state(*body, find_snapshot(baseline_id).get(), version, you);
     
-    //compute the message size and patch into the message header:
-    auto size = uint32_t(connection.send_buffer.size() - mark);
-    connection.send_buffer[mark - 3] = uint8_t(size);
-    connection.send_buffer[mark - 2] = uint8_t(size >> 8);
-    connection.send_buffer[mark - 1] = uint8_t(size >> 16);
+    auto size = uint32_t((version != 0 ? 1 : 0) + (version >= 2 ? 4 : 0) + body->size());
+    connection.send(version == 0 ? Message::S2C_State : Message::S2C_VersionedState);
+    connection.send(uint8_t(size));
+    connection.send(uint8_t(size >> 8));
+    connection.send(uint8_t(size >> 16));
+    if (version != 0) connection.send(version);
+    if (version >= 2) connection.send(you);
+    connection.send_shared(body);
 }
 
 bool Game::recv_state_message(Connection *connection_) {
@@ -382,7 +716,8 @@ bool Game::recv_state_message(Connection *connection_) {
     auto &recv_buffer = connection.recv_buffer;
     
     if (recv_buffer.size() < 4) return false;
-    if (recv_buffer[0] != uint8_t(Message::S2C_State)) return false;
+    if (recv_buffer[0] != uint8_t(Message::S2C_State)
+        && recv_buffer[0] != uint8_t(Message::S2C_VersionedState)) return false;
     uint32_t size = (uint32_t(recv_buffer[3]) << 16)
                     | (uint32_t(recv_buffer[2]) << 8)
                     | uint32_t(recv_buffer[1]);
@@ -391,47 +726,249 @@ bool Game::recv_state_message(Connection *connection_) {
     if (recv_buffer.size() < 4 + size) return false;
     
     //copy bytes from buffer and advance position:
-    auto read = [&](auto *val) {
-        if (at + sizeof(*val) > size) {
+    auto read_raw = [&](void *val, size_t bytes) {
+        if (at + bytes > size) {
             throw std::runtime_error("Ran out of bytes reading state message.");
         }
-        std::memcpy(val, &recv_buffer[4 + at], sizeof(*val));
-        at += sizeof(*val);
+        std::memcpy(val, &recv_buffer[4 + at], bytes);
+        at += uint32_t(bytes);
+    };
+    auto read = [&](auto *val) {
+        read_raw(val, sizeof(*val));
     };
     
-    players.clear();
-    uint8_t player_count;
-    read(&player_count);
-    for (uint8_t i = 0; i < player_count; ++i) {
-        players.emplace_back();
-        Player &player = players.back();
-        read(&player.at);
-        read(&player.rotation);
-        uint8_t name_len;
-        read(&name_len);
-        //n.b. would probably be more efficient to directly copy from recv_buffer, but I think this is clearer:
-        player.name = "";
-        for (uint8_t n = 0; n < name_len; ++n) {
-            char c;
-            read(&c);
-            player.name += c;
+    uint8_t version = 0;
+    if (recv_buffer[0] == uint8_t(Message::S2C_VersionedState)) {
+        read(&version);
+        if (version == 0 || version > ProtocolVersion) {
+            throw std::runtime_error("State message has unknown protocol version " + std::to_string(version) + ".");
+        }
+    }
+    
+    //which player is ours (before version 2, it was always sent first):
+    uint32_t you = 0;
+    if (version >= 2) read(&you);
+    
+    //read a position and rotation, in whichever form this version uses:
+    auto read_at_rotation = [&](WalkPoint *at_, glm::quat *rotation_) {
+        if (version == 0) {
+            *at_ = WalkPoint();
+            read(&at_->indices);
+            read(&at_->weights);
+            read(rotation_);
+        } else {
+            PackedWalkPoint pwp;
+            read(&pwp);
+            *at_ = walkmesh->unpack(pwp);
+            uint32_t bits;
+            read(&bits);
+            *rotation_ = unpack_rotation(bits);
+        }
+    };
+    
+    auto snapshot = std::make_shared<Snapshot>();
+    read(&snapshot->id);
+    
+    uint32_t baseline_id;
+    read(&baseline_id);
+    std::shared_ptr<Snapshot const> baseline;
+    if (baseline_id != 0) {
+        baseline = find_snapshot(baseline_id);
+        if (!baseline) {
+            throw std::runtime_error("State message is relative to unknown state " + std::to_string(baseline_id) + ".");
+        }
+    }
+    
+    uint32_t player_count;
+    if (version >= 3) {
+        read(&player_count);
+    } else {
+        uint8_t count;
+        read(&count);
+        player_count = count;
+    }
+    //(every player takes at least an id and flags, so a count the rest of the message can't hold is malformed)
+    if (player_count > (size - at) / (sizeof(uint32_t) + sizeof(uint8_t))) {
+        throw std::runtime_error("Player count in state message is larger than the message.");
+    }
+    for (uint32_t i = 0; i < player_count; ++i) {
+        uint32_t id;
+        read(&id);
+        uint8_t flags;
+        read(&flags);
+        
+        size_t b = size_t(-1);
+        if (baseline) {
+            auto f = std::find(baseline->player_id.begin(), baseline->player_id.end(), id);
+            if (f != baseline->player_id.end()) b = f - baseline->player_id.begin();
+        }
+        if ((flags & (PlayerMoved | PlayerNamed)) != (PlayerMoved | PlayerNamed) && b == size_t(-1)) {
+            throw std::runtime_error("State message refers to a player that isn't in its baseline.");
+        }
+        
+        snapshot->player_id.emplace_back(id);
+        snapshot->player_at.emplace_back();
+        snapshot->player_rotation.emplace_back();
+        snapshot->player_name.emplace_back();
+        if (flags & PlayerMoved) {
+            read_at_rotation(&snapshot->player_at.back(), &snapshot->player_rotation.back());
+        } else {
+            snapshot->player_at.back() = baseline->player_at[b];
+            snapshot->player_rotation.back() = baseline->player_rotation[b];
+        }
+        if (flags & PlayerNamed) {
+            uint8_t name_len;
+            read(&name_len);
+            std::string &name = snapshot->player_name.back();
+            name.resize(name_len);
+            read_raw(&name[0], name_len);
+        } else {
+            snapshot->player_name.back() = baseline->player_name[b];
         }
     }
     
-    sheeps.clear();
-    uint8_t sheep_count;
+    uint32_t sheep_count;
     read(&sheep_count);
-    for (uint8_t i = 0; i < sheep_count; ++i) {
-        sheeps.emplace_back();
-        Sheep &sheep = sheeps.back();
-        read(&sheep.at);
-        read(&sheep.rotation);
+    //(in size_t, so a huge count can't wrap around to a small bitmap)
+    size_t changed_size = (size_t(sheep_count) + 7) / 8;
+    if (changed_size > size - at) {
+        throw std::runtime_error("Sheep count in state message is larger than the message.");
+    }
+    //sheep past the end of the baseline must all be sent in full, so the rest of the message has to hold them:
+    size_t at_rotation_size = (version == 0
+                               ? sizeof(WalkPoint::indices) + sizeof(WalkPoint::weights) + sizeof(glm::quat)
+                               : sizeof(PackedWalkPoint) + sizeof(uint32_t));
+    size_t baseline_sheep = (baseline ? baseline->sheep_at.size() : 0);
+    if (sheep_count > baseline_sheep && sheep_count - baseline_sheep > (size - at - changed_size) / at_rotation_size) {
+        throw std::runtime_error("Sheep count in state message is larger than the message.");
+    }
+    std::vector<uint8_t> changed(changed_size);
+    read_raw(changed.data(), changed.size());
+    snapshot->sheep_at.resize(sheep_count);
+    snapshot->sheep_rotation.resize(sheep_count);
+    for (uint32_t i = 0; i < sheep_count; ++i) {
+        if (changed[i / 8] & (1 << (i % 8))) {
+            read_at_rotation(&snapshot->sheep_at[i], &snapshot->sheep_rotation[i]);
+        } else {
+            if (!baseline || i >= baseline->sheep_at.size()) {
+                throw std::runtime_error("State message refers to a sheep that isn't in its baseline.");
+            }
+            snapshot->sheep_at[i] = baseline->sheep_at[i];
+            snapshot->sheep_rotation[i] = baseline->sheep_rotation[i];
+        }
     }
     
     if (at != size) throw std::runtime_error("Trailing data in state message.");
     
     //delete message from buffer:
-    recv_buffer.erase(recv_buffer.begin(), recv_buffer.begin() + 4 + size);
+    recv_buffer.consume(4 + size);
+    
+    //the new snapshot becomes the current state (with our player first):
+    players.clear();
+    auto add_player = [&](size_t i) {
+        uint32_t index = players.index(players.push_back());
+        players.id[index] = snapshot->player_id[i];
+        players.at[index] = snapshot->player_at[i];
+        players.rotation[index] = snapshot->player_rotation[i];
+        players.name[index] = snapshot->player_name[i];
+    };
+    size_t first = size_t(-1);
+    if (you != 0) {
+        auto f = std::find(snapshot->player_id.begin(), snapshot->player_id.end(), you);
+        if (f != snapshot->player_id.end()) first = f - snapshot->player_id.begin();
+    }
+    if (first != size_t(-1)) add_player(first);
+    for (size_t i = 0; i < snapshot->player_id.size(); ++i) {
+        if (i == first) continue;
+        add_player(i);
+    }
+    sheeps.resize(sheep_count);
+    sheeps.at = snapshot->sheep_at;
+    sheeps.rotation = snapshot->sheep_rotation;
+    
+    //...and is remembered, since the server may send later states relative to it:
+    tick = snapshot->id;
+    snapshots.emplace_back(std::move(snapshot));
+    while (snapshots.size() > SnapshotHistory) {
+        snapshots.pop_front();
+    }
+    
+    return true;
+}
+
+void Game::send_hello_message(Connection *connection_, uint8_t version) {
+    assert(connection_);
+    auto &connection = *connection_;
+    
+    uint32_t size = 1;
+    connection.send(Message::C2S_Hello);
+    connection.send(uint8_t(size));
+    connection.send(uint8_t(size >> 8));
+    connection.send(uint8_t(size >> 16));
+    connection.send(version);
+}
+
+bool Game::recv_hello_message(Connection *connection_, uint8_t *version) {
+    assert(connection_);
+    auto &connection = *connection_;
+    assert(version);
+    
+    auto &recv_buffer = connection.recv_buffer;
+    
+    //expecting [type, size_low0, size_mid8, size_high8]:
+    if (recv_buffer.size() < 4) return false;
+    if (recv_buffer[0] != uint8_t(Message::C2S_Hello)) return false;
+    uint32_t size = (uint32_t(recv_buffer[3]) << 16)
+                    | (uint32_t(recv_buffer[2]) << 8)
+                    | uint32_t(recv_buffer[1]);
+    if (size != 1) throw std::runtime_error("Hello message with size " + std::to_string(size) + " != 1!");
+    
+    //expecting complete message:
+    if (recv_buffer.size() < 4 + size) return false;
+    
+    //a client newer than us gets the newest version we know:
+    *version = std::min<uint8_t>(recv_buffer[4], ProtocolVersion);
+    
+    //delete message from buffer:
+    recv_buffer.consume(4 + size);
+    
+    return true;
+}
+
+void Game::send_ack_message(Connection *connection_) const {
+    assert(connection_);
+    auto &connection = *connection_;
+    
+    uint32_t size = 4;
+    connection.send(Message::C2S_Ack);
+    connection.send(uint8_t(size));
+    connection.send(uint8_t(size >> 8));
+    connection.send(uint8_t(size >> 16));
+    connection.send(tick);
+}
+
+bool Game::recv_ack_message(Connection *connection_, uint32_t *acked) {
+    assert(connection_);
+    auto &connection = *connection_;
+    assert(acked);
+    
+    auto &recv_buffer = connection.recv_buffer;
+    
+    //expecting [type, size_low0, size_mid8, size_high8]:
+    if (recv_buffer.size() < 4) return false;
+    if (recv_buffer[0] != uint8_t(Message::C2S_Ack)) return false;
+    uint32_t size = (uint32_t(recv_buffer[3]) << 16)
+                    | (uint32_t(recv_buffer[2]) << 8)
+                    | uint32_t(recv_buffer[1]);
+    if (size != 4) throw std::runtime_error("Ack message with size " + std::to_string(size) + " != 4!");
+    
+    //expecting complete message:
+    if (recv_buffer.size() < 4 + size) return false;
+    
+    connection.recv(4, *acked);
+    
+    //delete message from buffer:
+    recv_buffer.consume(4 + size);
     
     return true;
 }
@@ -2,22 +2,32 @@
 
 #include "WalkMesh.hpp"
 #include "Load.hpp"
+#include "SpatialHash.hpp"
 
 #include <glm/glm.hpp>
 
 #include <string>
-#include <list>
+#include <vector>
+#include <deque>
+#include <memory>
 #include <random>
+#include <ctime>
 
 struct Connection;
+struct WorkerPool;
+struct Profiler;
 
 // Game state, separate from rendering.
 
-// Currently set up for a "client sends controls" / "server sends whole state" situation.
+// Currently set up for a "client sends controls" / "server sends state" situation.
+// The server only sends what changed since the last state the client acknowledged (see Snapshot, below).
 
 enum class Message : uint8_t {
     C2S_Controls = 1, // Greg!         jim i don't get it, what does greg mean
-    S2C_State = 's',
+    C2S_Ack = 'a', // "I have state <id>", so the server can send changes relative to it
+    C2S_Hello = 'h', // "I speak protocol version <n>" -- clients that never say hello get S2C_State
+    S2C_State = 's', // state with raw WalkPoints and quaternions (what clients from before protocol versions understand)
+    S2C_VersionedState = 'v', // state whose first byte is the protocol version it is encoded with (and from version 2, then the receiving client's player id)
 };
 
 // used to represent a control input:
@@ -26,7 +36,34 @@ struct Button {
     bool pressed = false; // is the button pressed now
 };
 
-// state of one player in the game:
+// small random number generator (PCG32, see https://www.pcg-random.org/) that each sheep carries a copy of,
+// so that sheep draw the same numbers no matter what order (or on which thread) they are updated:
+struct Rng {
+    uint64_t state = 0;
+    
+    explicit Rng(uint64_t seed = 0) {
+        // scramble the seed (splitmix64 finalizer) so that nearby seeds give unrelated streams:
+        seed += 0x9e3779b97f4a7c15ULL;
+        seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebULL;
+        state = seed ^ (seed >> 31);
+    }
+    
+    uint32_t operator()() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+        auto xorshifted = uint32_t(((old >> 18U) ^ old) >> 27U);
+        auto rot = uint32_t(old >> 59U);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31U));
+    }
+    
+    // uniform in [0,1]:
+    float unit() {
+        return float((*this)()) / float(0xffffffffU);
+    }
+};
+
+// one player in the game:
 struct Player {
     // player inputs (sent from client):
     struct Controls {
@@ -39,19 +76,65 @@ struct Player {
         // returns 'true' if read a controls message,
         // throws on malformed controls message
         bool recv_controls_message(Connection *connection);
-    } controls;
+    };
+    
+    // the player's state lives in Game::players (see Players, below), so a player is referred to by handle.
+    // a handle stays valid until its player is removed, even as other players come and go:
+    struct Handle {
+        uint32_t slot = -1U;
+        uint32_t generation = 0;
+    };
+};
+
+// all players in the game, stored structure-of-arrays style (player i is controls[i], at[i], rotation[i], ...)
+// so that each pass over the players only touches the arrays it needs:
+struct Players {
+    // player inputs (sent from client):
+    std::vector<Player::Controls> controls;
     
     // player state (sent from server):
-    WalkPoint at;
-    glm::quat rotation;
-    std::string name;
+    std::vector<uint32_t> id; // player number, never reused (so clients can match players up between states)
+    std::vector<WalkPoint> at;
+    std::vector<glm::quat> rotation;
+    std::vector<std::string> name;
+    
+    // walkmesh->to_world_point(at[i]), cached at the start of each update (server side only):
+    std::vector<glm::vec3> position;
+    
+    // where each player is walking this update (server side only; all players are walked at once):
+    std::vector<glm::vec3> step;
+    
+    size_t size() const { return at.size(); }
+    
+    void clear();
+    
+    // add a player to the end of the arrays (default-initialized) and return its handle:
+    Player::Handle push_back();
+    
+    // remove a player; the last player is moved into its place:
+    void erase(Player::Handle handle);
+    
+    // current index of a player in the arrays (asserts that the handle is valid):
+    uint32_t index(Player::Handle handle) const;
+    
+    bool valid(Player::Handle handle) const {
+        return handle.slot < slot_index.size()
+               && slot_generation[handle.slot] == handle.generation
+               && slot_index[handle.slot] != -1U;
+    }
+    
+    // internals:
+    std::vector<uint32_t> slot_index; // slot -> index in the arrays (or -1U if unused)
+    std::vector<uint32_t> slot_generation; // slot -> generation (bumped whenever the slot is freed)
+    std::vector<uint32_t> index_slot; // index in the arrays -> slot
+    std::vector<uint32_t> free_slots;
 };
 
-// state of one sheep in the game
-struct Sheep {
+// all sheep in the game, also structure-of-arrays style:
+struct Sheeps {
     // sheep state (sent from server):
-    WalkPoint at;
-    glm::quat rotation;
+    std::vector<WalkPoint> at;
+    std::vector<glm::quat> rotation;
     
     /*
      * Note: the rotations for the players and the sheep work differently. For sheep, forwards is
@@ -64,26 +147,92 @@ struct Sheep {
     
     // a random direction to go if there's nothing nearby
     // gets updated to a random value at random intervals, with average update time every 60 ticks
-    glm::vec3 bias;
+    std::vector<glm::vec3> bias;
+    
+    // each sheep's own random numbers (for bias changes):
+    std::vector<Rng> rng;
+    
+    // walkmesh->to_world_point(at[i]), cached at the start of each update:
+    std::vector<glm::vec3> position;
+    
+    // where each sheep is walking this update (set by Game::update_sheep):
+    std::vector<glm::vec3> step;
+    
+    size_t size() const { return at.size(); }
+    
+    void resize(size_t count);
 };
 
+// the part of the game state that clients see, as of one tick
+// (the server keeps the last few so it can send each client only what changed since one it has acknowledged):
+struct Snapshot {
+    uint32_t id = 0; // tick the snapshot was taken on (ids start at 1, so 0 means "no snapshot")
+    
+    std::vector<uint32_t> player_id;
+    std::vector<WalkPoint> player_at;
+    std::vector<glm::quat> player_rotation;
+    std::vector<std::string> player_name;
+    
+    std::vector<WalkPoint> sheep_at;
+    std::vector<glm::quat> sheep_rotation;
+};
+
+// the world's walkmeshes are loaded once per process, and shared by every Game in it (the first Game made loads them,
+// if this hasn't been called already); 'baked' is where the baked copy of world.w goes (see WalkMeshes::load_cached):
+void load_world_walkmeshes(std::string const &baked = "");
+
 struct Game {
-    std::list<Player> players; // (using list so they can have stable addresses)
-    Player *spawn_player(); // add player the end of the players list (may also, e.g., play some spawn anim)
-    void remove_player(Player *); // remove player from game (may also, e.g., play some despawn anim)
+    Players players;
+    Player::Handle spawn_player(); // add player the end of the players list (may also, e.g., play some spawn anim)
+    void remove_player(Player::Handle); // remove player from game (may also, e.g., play some despawn anim)
     
-    std::list<Sheep> sheeps;
+    Sheeps sheeps;
     
-    std::mt19937 mt; // used for spawning players
+    std::mt19937 mt; // used for spawning players and seeding sheep
     uint32_t next_player_number = 1; // used for naming players
     
     WalkMesh const *walkmesh;
     
-    Game();
+    // (the same seed gives the same game, as long as players do the same things)
+    explicit Game(size_t sheep_count = SheepCount, uint32_t seed = uint32_t(std::time(nullptr)));
     
     // state update function:
     void update(float elapsed);
     
+    // turn one sheep and decide where it walks (sheeps.step[i]), but don't move it yet;
+    // reads only its own state and the neighbor grids, writes only its own state:
+    void update_sheep(size_t i, float elapsed);
+    
+    // if set, the sheep part of update is split across these threads
+    // (each sheep only sees where the others were at the start of the tick, so results don't depend on this):
+    WorkerPool *workers = nullptr;
+    
+    // if set, update adds the time its player and sheep parts take to these (see Profiler):
+    Profiler *profiler = nullptr;
+    
+    // ---- neighbor queries (server side) ----
+    
+    // rebuilt from the cached positions once per update; cells are as big as the radius each is queried with:
+    SpatialHash player_grid = SpatialHash(SheepDetectPlayerRadius);
+    SpatialHash sheep_grid = SpatialHash(SheepDetectSheepRadius);
+    
+    // if false, sheep check every player and every other sheep instead (only useful for benchmarking):
+    bool use_spatial_hash = true;
+    
+    // ---- snapshots ----
+    
+    // server: the state after each update; client: each state received. oldest first, at most SnapshotHistory of them:
+    std::deque<std::shared_ptr<Snapshot const>> snapshots;
+    
+    // copy the current state into a new snapshot with the next id (called by update):
+    void record_snapshot();
+    
+    // look up a recent snapshot by id (returns null if it is too old or was never taken):
+    std::shared_ptr<Snapshot const> find_snapshot(uint32_t id) const;
+    
+    // id of the most recent snapshot:
+    uint32_t tick = 0;
+    
     // constants:
     // the update rate on the server:
     inline static constexpr float Tick = 1.0f / 30.0f;
@@ -96,6 +245,14 @@ struct Game {
     // used to detect when to hide players that are too close to yourself
     inline static constexpr float PlayerRadius = 1.06f;
     
+    // before protocol version 3, the player count was a byte, so those clients are only told about this many:
+    inline static constexpr size_t LegacyMaxPlayers = 255;
+    // most players one game takes (MatchManager turns away the rest) -- a state with every player moved and
+    // named stays well inside a message's 24-bit size, and searching the baseline for each player stays cheap:
+    inline static constexpr size_t MaxPlayers = 1024;
+    // (each: id, flags, packed walkpoint and rotation, name length and name)
+    static_assert(MaxPlayers * (4 + 1 + 8 + 4 + 1 + 255) < (1 << 24) / 4, "A state with every player must fit in a message.");
+    
     // sheep constants
     inline static constexpr size_t SheepCount = 15;
     inline static constexpr float SheepDetectPlayerRadius = 12.0f;
@@ -104,21 +261,66 @@ struct Game {
     inline static constexpr float SheepAvoidSheepConstant = 30.0f;
     inline static constexpr float SheepSpeed = 1.5f;
     
+    // about a second of snapshots at the server tick rate; clients acknowledging older states get sent everything:
+    inline static constexpr size_t SnapshotHistory = 32;
+    
+    // protocol versions:
+    //  0: S2C_State, WalkPoints and rotations sent as raw floats (40 bytes per entity)
+    //  1: S2C_VersionedState, WalkPoints packed (see PackedWalkPoint) and rotations sent "smallest three" style (12 bytes per entity)
+    //  2: as 1, but the client's own player is given by id instead of being sent first, so all clients can share one encoding
+    //  3: as 2, but the player count is a uint32_t rather than a byte (so more than 255 players fit)
+    inline static constexpr uint8_t ProtocolVersion = 3;
+    
     // ---- communication helpers ----
     
     // used by client:
-    // set game state from data in connection buffer
+    // set game state from data in connection buffer (and remember it as a snapshot)
     // (return true if data was read)
+    // throws if the message is malformed or is relative to a snapshot the client no longer has
     bool recv_state_message(Connection *connection);
     
+    // tell the server which protocol version we speak (sent once, right after connecting):
+    static void send_hello_message(Connection *connection, uint8_t version = ProtocolVersion);
+    
+    // tell the server which state we have (i.e., the latest snapshot):
+    void send_ack_message(Connection *connection) const;
+    
     // used by server:
-    // send game state.
+    // send the latest snapshot.
     //  Will move "connection_player" to the front of the front of the sent list.
-    void send_state_message(Connection *connection, Player *connection_player = nullptr) const;
+    //  Only sends what changed since snapshot 'baseline' (if it is still around; otherwise sends everything).
+    //  Encoded with protocol version 'version' (which should be one the client said it speaks).
+    void send_state_message(Connection *connection, Player::Handle connection_player = Player::Handle(),
+                            uint32_t baseline = 0, uint8_t version = ProtocolVersion) const;
+    
+    // the body of a (version 2+) state message relative to 'baseline', encoded once per tick and shared by every client that needs it:
+    std::shared_ptr<std::vector<uint8_t> const> shared_state(uint32_t baseline, uint8_t version = ProtocolVersion) const;
+    
+    // read a client's hello (returns true and sets *version to the version to talk to it with if one was read, throws if malformed):
+    static bool recv_hello_message(Connection *connection, uint8_t *version);
+    
+    // read a client's acknowledgement (returns true and sets *acked if one was read, throws if malformed):
+    static bool recv_ack_message(Connection *connection, uint32_t *acked);
+    
+    // internals for sending state:
+    // append the part of a state message that follows the version (or, from version 2, the client's player id) to 'out':
+    //  (before version 2, the player with id 'first_id' is put first; before version 3, only the first LegacyMaxPlayers
+    //   players are sent -- with 'first_id' always among them)
+    void encode_state(std::vector<uint8_t> &out, Snapshot const *baseline, uint8_t version, uint32_t first_id = 0) const;
+    
+    // shared_state's encodings so far this tick (a cache, hence mutable; only a few baselines are in use at once):
+    struct SharedState {
+        uint32_t baseline;
+        uint8_t version;
+        std::shared_ptr<std::vector<uint8_t> const> body;
+    };
+    mutable std::vector<SharedState> shared;
+    mutable uint32_t shared_tick = 0;
     
     // used for spawning things randomly
     glm::vec3 min_bound = glm::vec3(0.0f, 0.0f, 0.0f);
     glm::vec3 max_bound = glm::vec3(0.0f, 0.0f, 0.0f);
     
     glm::vec3 random_coordinates();
+    glm::vec3 random_coordinates(Rng &rng) const;
 };
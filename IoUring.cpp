@@ -0,0 +1,185 @@
+#include "IoUring.hpp"
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <system_error>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <cassert>
+
+IoUring::IoUring(uint32_t entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    //completions only need handling when the ring is polled:
+    // (not IORING_SETUP_SINGLE_ISSUER, though -- a Server may be made on one thread and polled on another)
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    //(multishot receives can complete many times per submission, so leave plenty of room for completions)
+    params.flags |= IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 8;
+
+    ring_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd < 0) {
+        throw std::system_error(errno, std::system_category(), "failed to set up io_uring");
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        close(ring_fd);
+        throw std::system_error(ENOSYS, std::system_category(), "io_uring is too old (no IORING_FEAT_EXT_ARG)");
+    }
+
+    //map the rings:
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        int error = errno;
+        close(ring_fd);
+        throw std::system_error(error, std::system_category(), "failed to map io_uring submission ring");
+    }
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            int error = errno;
+            munmap(sq_ring, sq_ring_size);
+            close(ring_fd);
+            throw std::system_error(error, std::system_category(), "failed to map io_uring completion ring");
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = reinterpret_cast<io_uring_sqe *>(
+            mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) {
+        int error = errno;
+        if (!single_mmap) munmap(cq_ring, cq_ring_size);
+        munmap(sq_ring, sq_ring_size);
+        close(ring_fd);
+        throw std::system_error(error, std::system_category(), "failed to map io_uring submission entries");
+    }
+
+    auto *sq = reinterpret_cast<uint8_t *>(sq_ring);
+    sq_head = reinterpret_cast<uint32_t *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+
+    auto *cq = reinterpret_cast<uint8_t *>(cq_ring);
+    cq_head = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    delete[] buffer_memory;
+    munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+    munmap(sq_ring, sq_ring_size);
+    close(ring_fd);
+}
+
+io_uring_sqe *IoUring::get_sqe() {
+    uint32_t tail = *sq_tail;
+    while (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) > sq_mask) {
+        //full, so hand what's there to the kernel:
+        uint32_t was_queued = queued;
+        enter(false, 0.0);
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) <= sq_mask) break;
+        
+        //the kernel can refuse (EBUSY) while its completion queue is overflowing -- e.g., multishot receives under
+        // load -- so make room there and try again:
+        size_t was_reaped = reaped.size();
+        reap();
+        if (queued == was_queued && reaped.size() == was_reaped) {
+            throw std::runtime_error("io_uring submission queue is full and the kernel isn't taking entries");
+        }
+    }
+    uint32_t index = tail & sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    queued += 1;
+    return sqe;
+}
+
+void IoUring::enter(bool wait, double timeout) {
+    __kernel_timespec ts;
+    ts.tv_sec = int64_t(std::floor(timeout));
+    ts.tv_nsec = int64_t((timeout - std::floor(timeout)) * 1e9);
+
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.ts = uint64_t(reinterpret_cast<uintptr_t>(&ts));
+
+    uint32_t flags = IORING_ENTER_EXT_ARG;
+    if (wait) flags |= IORING_ENTER_GETEVENTS;
+
+    enters += 1;
+    int ret = int(syscall(__NR_io_uring_enter, ring_fd, queued, wait ? 1 : 0, flags, &arg, sizeof(arg)));
+    if (ret < 0) {
+        //(nothing was submitted; it stays queued for next time)
+        if (errno != ETIME && errno != EINTR && errno != EBUSY) {
+            throw std::system_error(errno, std::system_category(), "io_uring_enter failed");
+        }
+        return;
+    }
+    //the kernel may take fewer than were queued:
+    queued -= std::min(queued, uint32_t(ret));
+}
+
+void IoUring::reap() {
+    uint32_t head = *cq_head;
+    uint32_t tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        reaped.push_back(cqes[head & cq_mask]);
+        ++head;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+void IoUring::setup_buffers(uint16_t group, uint16_t count, uint32_t size) {
+    assert(!buffer_memory && "only one buffer group per ring");
+
+    buffer_group = group;
+    buffer_count = count;
+    buffer_size = size;
+    buffer_memory = new uint8_t[size_t(count) * size];
+
+    //(one request provides the whole pool)
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = int32_t(count);
+    sqe->addr = uint64_t(reinterpret_cast<uintptr_t>(buffer_memory));
+    sqe->len = size;
+    sqe->off = 0; //first buffer id
+    sqe->buf_group = group;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+}
+
+void IoUring::return_buffer(uint16_t id) {
+    assert(id < buffer_count);
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = uint64_t(reinterpret_cast<uintptr_t>(buffer(id)));
+    sqe->len = buffer_size;
+    sqe->off = id;
+    sqe->buf_group = buffer_group;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+}
+
+#endif //HAVE_IO_URING
@@ -0,0 +1,122 @@
+#pragma once
+
+/*
+ * IoUring is a thin wrapper around a linux io_uring instance, talking to the
+ * kernel with raw syscalls (so no liburing dependency). It is used by the
+ * Server's io_uring backend (see Connection.cpp).
+ *
+ * Usage:
+ *  IoUring ring(1024); //submission queue entries
+ *  io_uring_sqe *sqe = ring.get_sqe(); //(zeroed) -- fill in, then:
+ *  ring.enter(true, 0.1); //submit everything queued; wait up to 0.1s for a completion
+ *  ring.for_each_cqe([&](io_uring_cqe const &cqe) { ... });
+ *
+ * It can also own a pool of "provided buffers" -- equal-sized buffers that the
+ * kernel picks from when a receive completes (IOSQE_BUFFER_SELECT), so receives
+ * don't need a buffer set aside per socket. The pool is handed over (and buffers
+ * are given back) with IORING_OP_PROVIDE_BUFFERS requests, which go out with the
+ * next enter() and only produce a completion if they fail.
+ */
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct IoUring {
+    //throws std::system_error if the kernel won't make a ring (e.g., too old, or io_uring is disabled):
+    explicit IoUring(uint32_t entries);
+    ~IoUring();
+
+    //the ring is tied to kernel resources, so no copying:
+    IoUring(IoUring const &) = delete;
+    IoUring &operator=(IoUring const &) = delete;
+
+    //next free submission queue entry, zeroed (submits what's queued first if the queue is full):
+    io_uring_sqe *get_sqe();
+
+    //number of entries that can be gotten before get_sqe() has to submit:
+    uint32_t space() const { return sq_mask + 1 - (*sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)); }
+
+    //submit queued entries; if 'wait', also wait up to 'timeout' seconds for at least one completion:
+    void enter(bool wait, double timeout);
+
+    //call fn(cqe) for each completion that's ready, marking each consumed before fn sees it; returns how many there were:
+    // (fn may get more entries -- and so maybe reap() -- so completions are taken one at a time, set-aside ones first)
+    template<typename F>
+    size_t for_each_cqe(F const &fn) {
+        size_t count = 0;
+        while (true) {
+            io_uring_cqe cqe;
+            if (reaped_next < reaped.size()) {
+                cqe = reaped[reaped_next++];
+            } else {
+                reaped.clear();
+                reaped_next = 0;
+                uint32_t head = *cq_head;
+                if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) break;
+                cqe = cqes[head & cq_mask];
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+            }
+            fn(cqe);
+            ++count;
+        }
+        return count;
+    }
+
+    //provide 'count' buffers of 'size' bytes each, as buffer group 'group':
+    void setup_buffers(uint16_t group, uint16_t count, uint32_t size);
+    //buffer 'id' (as in cqe.flags >> IORING_CQE_BUFFER_SHIFT):
+    uint8_t *buffer(uint16_t id) { return buffer_memory + size_t(id) * buffer_size; }
+    //give a buffer back to the kernel once done with its contents (takes a submission queue entry):
+    void return_buffer(uint16_t id);
+
+    uint64_t enters = 0; //number of io_uring_enter() calls so far (each one is a syscall)
+
+    //internals:
+    int ring_fd = -1;
+    uint32_t queued = 0; //entries filled in but not yet taken by the kernel
+
+    //move every ready completion out of the ring and into 'reaped' (for_each_cqe() hands them out first):
+    // used by get_sqe() when the kernel won't take submissions because completions are backed up
+    void reap();
+    std::vector<io_uring_cqe> reaped;
+    size_t reaped_next = 0;
+
+    void *sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void *cq_ring = nullptr; //(same as sq_ring if the kernel has IORING_FEAT_SINGLE_MMAP)
+    size_t cq_ring_size = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_size = 0;
+
+    uint32_t *sq_head = nullptr;
+    uint32_t *sq_tail = nullptr;
+    uint32_t sq_mask = 0;
+    uint32_t *sq_array = nullptr;
+
+    uint32_t *cq_head = nullptr;
+    uint32_t *cq_tail = nullptr;
+    uint32_t cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    uint16_t buffer_group = 0;
+    uint16_t buffer_count = 0;
+    uint32_t buffer_size = 0;
+    uint8_t *buffer_memory = nullptr;
+};
+
+#else //no io_uring here; just enough to let Server hold a (null) pointer to one:
+
+struct IoUring { };
+
+#endif //HAVE_IO_URING
@@ -43,69 +43,102 @@ Load<LitColorTextureProgram> lit_color_texture_program(LoadTagEarly, []() -> Lit
     return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+Load<LitColorTextureProgram> lit_color_texture_instanced_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
+    return new LitColorTextureProgram(true);
+});
+
+//the two variants differ only in where their per-object matrices come from:
+static char const *VertexShader =
+    "#version 330\n"
+    "uniform mat4 OBJECT_TO_CLIP;\n"
+    "uniform mat4x3 OBJECT_TO_LIGHT;\n"
+    "uniform mat3 NORMAL_TO_LIGHT;\n"
+    "in vec4 Position;\n"
+    "in vec3 Normal;\n"
+    "in vec4 Color;\n"
+    "in vec2 TexCoord;\n"
+    "out vec3 position;\n"
+    "out vec3 normal;\n"
+    "out vec4 color;\n"
+    "out vec2 texCoord;\n"
+    "void main() {\n"
+    "	gl_Position = OBJECT_TO_CLIP * Position;\n"
+    "	position = OBJECT_TO_LIGHT * Position;\n"
+    "	normal = NORMAL_TO_LIGHT * Normal;\n"
+    "	color = Color;\n"
+    "	texCoord = TexCoord;\n"
+    "}\n";
+
+//(per-object matrices as per-instance attributes):
+static char const *InstancedVertexShader =
+    "#version 330\n"
+    "uniform mat4 WORLD_TO_CLIP;\n"
+    "uniform mat4x3 WORLD_TO_LIGHT;\n"
+    "in vec4 Position;\n"
+    "in vec3 Normal;\n"
+    "in vec4 Color;\n"
+    "in vec2 TexCoord;\n"
+    "in mat4x3 ObjectToWorld;\n"
+    "in mat3 NormalToLight;\n"
+    "out vec3 position;\n"
+    "out vec3 normal;\n"
+    "out vec4 color;\n"
+    "out vec2 texCoord;\n"
+    "void main() {\n"
+    "	vec4 world = vec4(ObjectToWorld * Position, 1.0);\n"
+    "	gl_Position = WORLD_TO_CLIP * world;\n"
+    "	position = WORLD_TO_LIGHT * world;\n"
+    "	normal = NormalToLight * Normal;\n"
+    "	color = Color;\n"
+    "	texCoord = TexCoord;\n"
+    "}\n";
+
+static char const *FragmentShader =
+    "#version 330\n"
+    "uniform sampler2D TEX;\n"
+    "uniform int LIGHT_TYPE;\n"
+    "uniform vec3 LIGHT_LOCATION;\n"
+    "uniform vec3 LIGHT_DIRECTION;\n"
+    "uniform vec3 LIGHT_ENERGY;\n"
+    "uniform float LIGHT_CUTOFF;\n"
+    "in vec3 position;\n"
+    "in vec3 normal;\n"
+    "in vec4 color;\n"
+    "in vec2 texCoord;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "	vec3 n = normalize(normal);\n"
+    "	vec3 e;\n"
+    "	if (LIGHT_TYPE == 0) { //point light \n"
+    "		vec3 l = (LIGHT_LOCATION - position);\n"
+    "		float dis2 = dot(l,l);\n"
+    "		l = normalize(l);\n"
+    "		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+    "		e = nl * LIGHT_ENERGY;\n"
+    "	} else if (LIGHT_TYPE == 1) { //hemi light \n"
+    "		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
+    "	} else if (LIGHT_TYPE == 2) { //spot light \n"
+    "		vec3 l = (LIGHT_LOCATION - position);\n"
+    "		float dis2 = dot(l,l);\n"
+    "		l = normalize(l);\n"
+    "		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+    "		float c = dot(l,-LIGHT_DIRECTION);\n"
+    "		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
+    "		e = nl * LIGHT_ENERGY;\n"
+    "	} else { //(LIGHT_TYPE == 3) //directional light \n"
+    "		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+    "	}\n"
+    "	vec4 albedo = texture(TEX, texCoord) * color;\n"
+    "	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
+    "}\n";
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced_) : instanced(instanced_) {
     //Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
     program = gl_compile_program(
-            //vertex shader:
-            "#version 330\n"
-            "uniform mat4 OBJECT_TO_CLIP;\n"
-            "uniform mat4x3 OBJECT_TO_LIGHT;\n"
-            "uniform mat3 NORMAL_TO_LIGHT;\n"
-            "in vec4 Position;\n"
-            "in vec3 Normal;\n"
-            "in vec4 Color;\n"
-            "in vec2 TexCoord;\n"
-            "out vec3 position;\n"
-            "out vec3 normal;\n"
-            "out vec4 color;\n"
-            "out vec2 texCoord;\n"
-            "void main() {\n"
-            "	gl_Position = OBJECT_TO_CLIP * Position;\n"
-            "	position = OBJECT_TO_LIGHT * Position;\n"
-            "	normal = NORMAL_TO_LIGHT * Normal;\n"
-            "	color = Color;\n"
-            "	texCoord = TexCoord;\n"
-            "}\n",
-            //fragment shader:
-            "#version 330\n"
-            "uniform sampler2D TEX;\n"
-            "uniform int LIGHT_TYPE;\n"
-            "uniform vec3 LIGHT_LOCATION;\n"
-            "uniform vec3 LIGHT_DIRECTION;\n"
-            "uniform vec3 LIGHT_ENERGY;\n"
-            "uniform float LIGHT_CUTOFF;\n"
-            "in vec3 position;\n"
-            "in vec3 normal;\n"
-            "in vec4 color;\n"
-            "in vec2 texCoord;\n"
-            "out vec4 fragColor;\n"
-            "void main() {\n"
-            "	vec3 n = normalize(normal);\n"
-            "	vec3 e;\n"
-            "	if (LIGHT_TYPE == 0) { //point light \n"
-            "		vec3 l = (LIGHT_LOCATION - position);\n"
-            "		float dis2 = dot(l,l);\n"
-            "		l = normalize(l);\n"
-            "		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-            "		e = nl * LIGHT_ENERGY;\n"
-            "	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-            "		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-            "	} else if (LIGHT_TYPE == 2) { //spot light \n"
-            "		vec3 l = (LIGHT_LOCATION - position);\n"
-            "		float dis2 = dot(l,l);\n"
-            "		l = normalize(l);\n"
-            "		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-            "		float c = dot(l,-LIGHT_DIRECTION);\n"
-            "		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-            "		e = nl * LIGHT_ENERGY;\n"
-            "	} else { //(LIGHT_TYPE == 3) //directional light \n"
-            "		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
-            "	}\n"
-            "	vec4 albedo = texture(TEX, texCoord) * color;\n"
-            "	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
-            "}\n"
+            instanced ? InstancedVertexShader : VertexShader,
+            FragmentShader
     );
-    //As you can see above, adjacent strings in C/C++ are concatenated.
+    //As you can see in the shaders above, adjacent strings in C/C++ are concatenated.
     // this is very useful for writing long shader programs inline.
     
     //look up the locations of vertex attributes:
@@ -113,11 +146,15 @@ LitColorTextureProgram::LitColorTextureProgram() {
     Normal_vec3 = glGetAttribLocation(program, "Normal");
     Color_vec4 = glGetAttribLocation(program, "Color");
     TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
+    ObjectToWorld_mat4x3 = glGetAttribLocation(program, "ObjectToWorld");
+    NormalToLight_mat3 = glGetAttribLocation(program, "NormalToLight");
     
     //look up the locations of uniforms:
     OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
     OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
     NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+    WORLD_TO_CLIP_mat4 = glGetUniformLocation(program, "WORLD_TO_CLIP");
+    WORLD_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "WORLD_TO_LIGHT");
     
     LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
     LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
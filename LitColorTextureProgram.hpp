@@ -5,12 +5,14 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// (the 'instanced' variant takes per-object matrices as per-instance attributes, for Scene::Instanced drawing)
 struct LitColorTextureProgram {
-    LitColorTextureProgram();
+    explicit LitColorTextureProgram(bool instanced = false);
     
     ~LitColorTextureProgram();
     
     GLuint program = 0;
+    bool instanced = false;
     
     //Attribute (per-vertex variable) locations:
     GLuint Position_vec4 = -1U;
@@ -18,11 +20,19 @@ struct LitColorTextureProgram {
     GLuint Color_vec4 = -1U;
     GLuint TexCoord_vec2 = -1U;
     
+    //(instanced) per-instance attribute locations:
+    GLuint ObjectToWorld_mat4x3 = -1U;
+    GLuint NormalToLight_mat3 = -1U;
+    
     //Uniform (per-invocation variable) locations:
     GLuint OBJECT_TO_CLIP_mat4 = -1U;
     GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
     GLuint NORMAL_TO_LIGHT_mat3 = -1U;
     
+    //(instanced) in place of the above:
+    GLuint WORLD_TO_CLIP_mat4 = -1U;
+    GLuint WORLD_TO_LIGHT_mat4x3 = -1U;
+    
     //lighting:
     GLuint LIGHT_TYPE_int = -1U;
     GLuint LIGHT_LOCATION_vec3 = -1U;
@@ -35,6 +45,7 @@ struct LitColorTextureProgram {
 };
 
 extern Load<LitColorTextureProgram> lit_color_texture_program;
+extern Load<LitColorTextureProgram> lit_color_texture_instanced_program;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
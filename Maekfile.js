@@ -142,6 +142,14 @@ const server_names = [
 	maek.CPP('server.cpp')
 ];
 
+const bench_names = [
+	maek.CPP('bench.cpp')
+];
+
+const bots_names = [
+	maek.CPP('bots.cpp')
+];
+
 const common_names = [
 	maek.CPP('Game.cpp'),
 	maek.CPP('data_path.cpp'),
@@ -158,7 +166,16 @@ const common_names = [
 	maek.CPP('Load.cpp'),
 	maek.CPP('Connection.cpp'),
 	maek.CPP('hex_dump.cpp'),
-	maek.CPP('WalkMesh.cpp')
+	maek.CPP('WalkMesh.cpp'),
+	maek.CPP('MappedFile.cpp'),
+	maek.CPP('FileLock.cpp'),
+	maek.CPP('SpatialHash.cpp'),
+	maek.CPP('WorkerPool.cpp'),
+	maek.CPP('IoUring.cpp'),
+	maek.CPP('NetworkThread.cpp'),
+	maek.CPP('MatchManager.cpp'),
+	maek.CPP('Profiler.cpp'),
+	maek.CPP('TickScheduler.cpp')
 ];
 
 const show_meshes_names = [
@@ -179,11 +196,13 @@ const show_scene_names = [
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
 const client_exe = maek.LINK([...client_names, ...common_names], 'dist/client');
 const server_exe = maek.LINK([...server_names, ...common_names], 'dist/server');
+const bench_exe = maek.LINK([...bench_names, ...common_names], 'dist/bench');
+const bots_exe = maek.LINK([...bots_names, ...common_names], 'dist/bots');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [client_exe, server_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [client_exe, server_exe, bench_exe, bots_exe, show_meshes_exe, show_scene_exe, ...copies];
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
@@ -0,0 +1,85 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string const &filename) {
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to get size of '" + filename + "'.");
+    }
+    size = size_t(file_size.QuadPart);
+    if (size == 0) return; //(can't map an empty file, but there's nothing to look at anyway)
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map '" + filename + "'.");
+    }
+    data = reinterpret_cast<uint8_t const *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Failed to map a view of '" + filename + "'.");
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+}
+
+#else //posix
+
+MappedFile::MappedFile(std::string const &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open '" + filename + "' for mapping: " + std::strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Failed to get size of '" + filename + "': " + std::strerror(error));
+    }
+    size = size_t(info.st_size);
+    if (size == 0) { //(can't map an empty file, but there's nothing to look at anyway)
+        close(fd);
+        return;
+    }
+
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd); //(the mapping keeps the file open)
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Failed to map '" + filename + "': " + std::strerror(error));
+    }
+    data = reinterpret_cast<uint8_t const *>(mapped);
+}
+
+MappedFile::~MappedFile() {
+    if (data) munmap(const_cast<uint8_t *>(data), size);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file into memory, read-only:
+ *
+ *  MappedFile file("world.w.baked"); //throws std::runtime_error if the file can't be opened or mapped
+ *  uint8_t const *bytes = file.data; //file.size bytes, page-aligned
+ *
+ * Pages are loaded from the file as they are touched, and are shared with
+ * every other process that maps the same file.
+ */
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct MappedFile {
+    explicit MappedFile(std::string const &filename);
+    ~MappedFile();
+
+    //the mapping belongs to this object, so no copying:
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    uint8_t const *data = nullptr;
+    size_t size = 0;
+
+    //internals:
+#ifdef _WIN32
+    void *file = nullptr; //(HANDLEs)
+    void *mapping = nullptr;
+#endif
+};
@@ -0,0 +1,90 @@
+#include "MatchManager.hpp"
+
+#include "WorkerPool.hpp"
+#include "Profiler.hpp"
+
+#include <cassert>
+#include <stdexcept>
+
+MatchManager::MatchManager(size_t match_count, WorkerPool *workers_, size_t sheep_count, uint32_t seed) : workers(workers_) {
+    if (match_count == 0) throw std::runtime_error("A match manager needs at least one match.");
+
+    matches.reserve(match_count);
+    for (size_t i = 0; i < match_count; ++i) {
+        matches.emplace_back(std::make_unique<Match>(i, sheep_count, uint32_t(seed + i)));
+    }
+
+    //a lone match can use the pool for its sheep; otherwise the pool is busy running matches
+    // (and a pool can't run a parallel_for from inside one of its own):
+    if (matches.size() == 1) {
+        matches[0]->game.workers = workers;
+    }
+}
+
+MatchManager::Match *MatchManager::add_client(uint64_t key) {
+    assert(!client_match.count(key) && "client added twice");
+
+    Match *emptiest = matches[0].get();
+    for (auto const &match: matches) {
+        if (match->clients.size() < emptiest->clients.size()) emptiest = match.get();
+    }
+    if (emptiest->clients.size() >= Game::MaxPlayers) return nullptr;
+
+    emptiest->clients.emplace(key, ClientInfo{emptiest->game.spawn_player()});
+    client_match.emplace(key, emptiest->index);
+    return emptiest;
+}
+
+void MatchManager::remove_client(uint64_t key) {
+    auto f = client_match.find(key);
+    assert(f != client_match.end());
+    Match &match = *matches[f->second];
+    client_match.erase(f);
+
+    auto c = match.clients.find(key);
+    assert(c != match.clients.end());
+    match.game.remove_player(c->second.player);
+    match.clients.erase(c);
+}
+
+MatchManager::Client MatchManager::client(uint64_t key) {
+    auto f = client_match.find(key);
+    assert(f != client_match.end());
+    Match &match = *matches[f->second];
+
+    auto c = match.clients.find(key);
+    assert(c != match.clients.end());
+    return Client{match, c->second};
+}
+
+void MatchManager::tick(uint32_t steps, std::function<void(Match &, uint64_t, ClientInfo &)> const &send) {
+    auto tick_matches = [&](size_t begin, size_t end) {
+        uint64_t degraded = 0;
+        for (size_t i = begin; i < end; ++i) {
+            Match &match = *matches[i];
+            for (uint32_t s = 0; s < steps; ++s) {
+                match.game.update(Game::Tick);
+            }
+            for (auto &[key, info]: match.clients) {
+                //(clients that never acknowledge anything can't be told apart from lagging ones, so they always get sent to)
+                bool lagging = degrade_lagging && info.acked != 0 && match.game.tick - info.acked > LaggingTicks;
+                if (lagging && match.game.tick - info.sent < LaggingInterval) {
+                    degraded += 1;
+                    continue;
+                }
+                info.sent = match.game.tick;
+                send(match, key, info);
+            }
+        }
+        if (degraded) {
+            degraded_sends.fetch_add(degraded, std::memory_order_relaxed);
+            if (profiler) profiler->count(Profiler::DegradedSends, degraded);
+        }
+    };
+
+    if (workers && matches.size() > 1) {
+        workers->parallel_for(matches.size(), tick_matches, 1);
+    } else {
+        tick_matches(0, matches.size());
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+/*
+ * MatchManager runs several independent matches (Games) in one server process,
+ * all behind the same listener:
+ *
+ *  MatchManager matches(4, &workers); //four matches, ticked on the pool
+ *  matches.add_client(key); //on connect: joins whichever match has the fewest players (null if all are full)
+ *  matches.client(key); //on receive: the client's match and ClientInfo
+ *  matches.tick([&](MatchManager::Match &match, uint64_t key, ClientInfo &info) {
+ *      match.game.send_state_message(...); //called for every client once its match has updated
+ *  });
+ *
+ * Clients are identified by whatever key the network side uses (a Connection
+ * pointer, a NetworkThread client number, ...).
+ *
+ * The matches all walk on the same (immutable) world walkmeshes, so an extra
+ * match costs about as much memory as its players and sheep.
+ *
+ * Clients that have fallen far behind (see degrade_lagging) can be sent fewer
+ * states, so a struggling connection gets a few bigger deltas rather than a
+ * growing backlog of states it will never catch up on.
+ *
+ * With more than one match, tick() spreads the matches across the pool (one
+ * match per chunk) and the games themselves run single-threaded; with just
+ * one match the game gets the pool to spread its sheep across instead.
+ */
+
+#include "Game.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <ctime>
+
+struct WorkerPool;
+struct Profiler;
+
+//keep track of which client is controlling which player, and what state it last acknowledged:
+struct ClientInfo {
+    Player::Handle player;
+    uint32_t acked = 0; //snapshot id of the last state the client received (0 => none, send everything)
+    uint8_t version = 0; //protocol version to send with (clients that never say hello only understand version 0)
+    uint32_t sent = 0; //snapshot id of the last state sent to the client
+    uint32_t version_from = 0; //snapshot id of the first state sent with 'version'
+
+    //hello message: send with 'version_' from the next state on (the client's match is at snapshot 'tick'):
+    void set_version(uint8_t version_, uint32_t tick) {
+        if (version_ == version) return;
+        version = version_;
+        version_from = tick + 1;
+        acked = 0;
+    }
+    //ack message: acks may arrive out of order, so only move forward -- and states sent with an older version
+    // may have left players out (see Game::LegacyMaxPlayers), so acks of those can't be used as baselines:
+    void ack(uint32_t snapshot) {
+        if (snapshot < version_from) return;
+        acked = std::max(acked, snapshot);
+    }
+};
+
+struct MatchManager {
+    //matches are seeded with seed, seed + 1, ... so they don't all start out looking the same:
+    MatchManager(size_t match_count, WorkerPool *workers, size_t sheep_count = Game::SheepCount, uint32_t seed = uint32_t(std::time(nullptr)));
+
+    //one game, and the clients playing in it:
+    struct Match {
+        Match(size_t index, size_t sheep_count, uint32_t seed) : index(index), game(sheep_count, seed) { }
+        size_t index; //position in 'matches'
+        Game game;
+        std::unordered_map<uint64_t, ClientInfo> clients; //by client key
+    };
+    std::vector<std::unique_ptr<Match>> matches; //(pointers so Games don't move around)
+
+    WorkerPool *workers = nullptr; //(may be null -- matches are then ticked one after the other)
+    Profiler *profiler = nullptr; //(if set, degraded sends are counted there too)
+
+    //add a client to the match with the fewest players (spawning a player for it there);
+    // returns null -- and adds nothing -- if every match already has Game::MaxPlayers players:
+    Match *add_client(uint64_t key);
+    //remove a client (and its player) from whatever match it is in:
+    void remove_client(uint64_t key);
+
+    //look up a client's match and info (client must have been added):
+    struct Client {
+        Match &match;
+        ClientInfo &info;
+    };
+    Client client(uint64_t key);
+
+    //update every match by 'steps' steps of Game::Tick (more than one when catching up, see TickScheduler),
+    // then call send(match, key, info) for each of its clients that should get a state this tick
+    // (send may be called from several threads at once, but only ever for one match per thread):
+    void tick(uint32_t steps, std::function<void(Match &match, uint64_t key, ClientInfo &info)> const &send);
+
+    //if set, clients whose last acknowledged state is more than LaggingTicks old only get a state every LaggingInterval ticks:
+    bool degrade_lagging = false;
+    inline static constexpr uint32_t LaggingTicks = 8;
+    inline static constexpr uint32_t LaggingInterval = 4;
+    std::atomic<uint64_t> degraded_sends{0}; //states not sent because of that
+
+    size_t client_count() const { return client_match.size(); }
+
+    std::unordered_map<uint64_t, size_t> client_match; //client key -> index in 'matches'
+};
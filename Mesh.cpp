@@ -1,5 +1,6 @@
 #include "Mesh.hpp"
 #include "read_write_chunk.hpp"
+#include "Scene.hpp"
 
 #include <glm/glm.hpp>
 
@@ -107,7 +108,7 @@ const Mesh &MeshBuffer::lookup(std::string const &name) const {
     return f->second;
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint instance_buffer) const {
     //create a new vertex array object:
     GLuint vao = 0;
     glGenVertexArrays(1, &vao);
@@ -129,6 +130,25 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
     bind_attribute("Normal", Normal);
     bind_attribute("Color", Color);
     bind_attribute("TexCoord", TexCoord);
+    
+    //per-instance matrices take one attribute location per column, and advance once per instance:
+    static_assert(sizeof(Scene::Instance) == (12 + 9) * sizeof(float), "Instances are tightly packed.");
+    if (instance_buffer != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        auto bind_instance_attribute = [&](char const *name, GLuint columns, GLuint rows, size_t offset) {
+            GLint location = glGetAttribLocation(program, name);
+            if (location == -1) return;
+            for (GLuint c = 0; c < columns; ++c) {
+                glVertexAttribPointer(location + c, rows, GL_FLOAT, GL_FALSE, sizeof(Scene::Instance),
+                                      (GLbyte *) nullptr + offset + c * rows * sizeof(float));
+                glEnableVertexAttribArray(location + c);
+                glVertexAttribDivisor(location + c, 1);
+            }
+            bound.insert(location);
+        };
+        bind_instance_attribute("ObjectToWorld", 4, 3, offsetof(Scene::Instance, object_to_world));
+        bind_instance_attribute("NormalToLight", 3, 3, offsetof(Scene::Instance, normal_to_light));
+    }
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     
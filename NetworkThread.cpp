@@ -0,0 +1,153 @@
+#include "NetworkThread.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <cassert>
+
+NetworkThread::NetworkThread(std::string const &port, Server::Backend backend)
+        : inputs(1 << 16), frames(8), server(port, backend) {
+    thread = std::thread(&NetworkThread::run, this);
+}
+
+NetworkThread::~NetworkThread() {
+    quit = true;
+    thread.join();
+}
+
+void NetworkThread::Input::add_controls_to(Player::Controls *to) const {
+    assert(type == Controls);
+    auto add_button = [](Button const &from, Button *button) {
+        button->pressed = from.pressed;
+        button->downs = uint8_t(std::min(255U, uint32_t(button->downs) + uint32_t(from.downs)));
+    };
+    add_button(controls.left, &to->left);
+    add_button(controls.right, &to->right);
+    add_button(controls.up, &to->up);
+    add_button(controls.down, &to->down);
+    to->mousex += controls.mousex;
+}
+
+void NetworkThread::publish(std::unique_ptr<Frame> &&frame) {
+    if (!frames.push(std::move(frame))) {
+        dropped_frames += 1;
+    }
+}
+
+NetworkThread::Output NetworkThread::stage_state(Game const &game, uint32_t client, Player::Handle player,
+                                                 uint32_t baseline, uint8_t version) {
+    Connection staged; //(never connected -- just collects what would be sent)
+    game.send_state_message(&staged, player, baseline, version);
+
+    Output output;
+    output.client = client;
+    output.data = std::move(staged.send_queue);
+    if (!staged.send_buffer.empty()) {
+        output.data.emplace_back(std::make_shared<std::vector<uint8_t> const>(staged.send_buffer.take()));
+    }
+    return output;
+}
+
+void NetworkThread::push_input(Input &&input) {
+    //(once something is held, everything after it has to be held too, to keep the order)
+    if (held.empty() && inputs.push(std::move(input))) return;
+    if (held.empty()) input_stalls += 1;
+    held.emplace_back(std::move(input));
+}
+
+void NetworkThread::run() {
+    auto on_event = [&](Connection *c, Connection::Event evt) {
+        if (evt == Connection::OnOpen) {
+            uint32_t client = next_client++;
+            client_connection.emplace(client, c);
+            connection_client.emplace(c, client);
+            Input input;
+            input.type = Input::Open;
+            input.client = client;
+            push_input(std::move(input));
+            return;
+        }
+
+        auto f = connection_client.find(c);
+        assert(f != connection_client.end());
+        uint32_t client = f->second;
+
+        auto remove_connection = [&]() {
+            client_connection.erase(client);
+            connection_client.erase(f);
+            Input input;
+            input.type = Input::Close;
+            input.client = client;
+            push_input(std::move(input));
+        };
+
+        if (evt == Connection::OnClose) {
+            remove_connection();
+            return;
+        }
+
+        assert(evt == Connection::OnRecv);
+        //decode messages from client (same as the single-threaded loop in server.cpp, but into Inputs):
+        try {
+            bool handled_message;
+            do {
+                handled_message = false;
+                Input input;
+                input.client = client;
+                if (input.controls.recv_controls_message(c)) {
+                    input.type = Input::Controls;
+                    push_input(std::move(input));
+                    handled_message = true;
+                    continue;
+                }
+                uint8_t version;
+                if (Game::recv_hello_message(c, &version)) {
+                    input.type = Input::Hello;
+                    input.value = version;
+                    push_input(std::move(input));
+                    handled_message = true;
+                    continue;
+                }
+                if (Game::recv_ack_message(c, &input.value)) {
+                    input.type = Input::Ack;
+                    push_input(std::move(input));
+                    handled_message = true;
+                }
+            } while (handled_message);
+        } catch (std::exception const &e) {
+            std::cout << "Disconnecting client:" << e.what() << std::endl;
+            c->close();
+            remove_connection();
+        }
+    };
+
+    while (!quit) {
+        //hand the latest states to their connections:
+        std::unique_ptr<Frame> frame;
+        while (frames.pop(&frame)) {
+            for (auto &output: *frame) {
+                auto f = client_connection.find(output.client);
+                if (f == client_connection.end()) continue; //(disconnected since)
+                for (auto &data: output.data) {
+                    f->second->send_shared(data);
+                }
+                if (output.close) {
+                    f->second->close();
+                    connection_client.erase(f->second);
+                    client_connection.erase(f);
+                    Input input;
+                    input.type = Input::Close;
+                    input.client = output.client;
+                    push_input(std::move(input));
+                }
+            }
+        }
+
+        //retry inputs that didn't fit before:
+        while (!held.empty() && inputs.push(std::move(held.front()))) {
+            held.pop_front();
+        }
+
+        server.poll(on_event, PollTimeout);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * NetworkThread runs a Server on its own thread, so the simulation thread
+ * never waits on sockets (see the "pipelined" mode in server.cpp):
+ *
+ *  - the network thread polls the sockets, decodes what clients send, and
+ *    pushes it as Input events onto 'inputs';
+ *  - the simulation thread pops those at the start of each tick, updates the
+ *    game, and publishes each client's encoded state for that tick as a Frame;
+ *  - the network thread hands published frames to the connections and sends them.
+ *
+ * Clients are referred to by number (never reused) rather than by Connection
+ * pointer, since only the network thread knows which connections still exist.
+ */
+
+#include "Connection.hpp"
+#include "Game.hpp"
+#include "SpscQueue.hpp"
+
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+
+struct NetworkThread {
+    //starts listening on 'port' (throws if that fails, like Server) and starts the thread:
+    explicit NetworkThread(std::string const &port, Server::Backend backend = Server::DefaultBackend);
+    ~NetworkThread();
+
+    NetworkThread(NetworkThread const &) = delete;
+    NetworkThread &operator=(NetworkThread const &) = delete;
+
+    //network -> simulation:
+    struct Input {
+        enum Type : uint8_t {
+            Open, //a client connected
+            Close, //a client disconnected (or was disconnected for sending garbage)
+            Controls, //a controls message, in 'controls' (downs and mousex are just this message's)
+            Hello, //a hello message, with the protocol version to use in 'value'
+            Ack, //an ack message, with the acknowledged snapshot id in 'value'
+        } type = Open;
+        uint32_t client = 0;
+        uint32_t value = 0;
+        Player::Controls controls;
+
+        //(Controls) add to a player's controls, same as if recv_controls_message had read the message into them:
+        void add_controls_to(Player::Controls *to) const;
+    };
+    SpscQueue<Input> inputs;
+
+    //simulation -> network, one per tick:
+    struct Output {
+        uint32_t client = 0;
+        std::deque<std::shared_ptr<std::vector<uint8_t> const>> data; //(sent in order)
+        bool close = false; //then disconnect the client (e.g., when there was no room for it)
+    };
+    typedef std::vector<Output> Frame;
+    SpscQueue<std::unique_ptr<Frame>> frames;
+
+    //(simulation thread) hand over a tick's states; if the network thread has fallen so far behind that the
+    // queue is full, the frame is dropped (clients get a delta against what they acked next time, so that's ok):
+    void publish(std::unique_ptr<Frame> &&frame);
+
+    //(simulation thread) what send_state_message would have sent on a connection, as an Output:
+    static Output stage_state(Game const &game, uint32_t client, Player::Handle player, uint32_t baseline, uint8_t version);
+
+    std::atomic<uint64_t> dropped_frames{0};
+    std::atomic<uint64_t> input_stalls{0}; //times 'inputs' was full and the network thread had to hold on to events
+
+    //network thread only:
+    Server server;
+    std::unordered_map<uint32_t, Connection *> client_connection;
+    std::unordered_map<Connection *, uint32_t> connection_client;
+    uint32_t next_client = 1;
+    std::deque<Input> held; //inputs that didn't fit in 'inputs' yet
+
+    //how long a poll waits for socket activity before checking for new frames (seconds):
+    inline static constexpr double PollTimeout = 0.001;
+
+    std::atomic<bool> quit{false};
+    std::thread thread;
+
+    void run();
+    void push_input(Input &&input);
+};
@@ -14,11 +14,22 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <array>
+#include <iterator>
 
 GLuint world_meshes_for_lit_color_texture_program = 0;
+//players and sheep are drawn instanced -- one draw call each, however big the herd gets:
+Scene::Instanced player_instanced, sheep_instanced;
 Load<MeshBuffer> world_meshes(LoadTagDefault, []() -> MeshBuffer const * {
     MeshBuffer const *ret = new MeshBuffer(data_path("world.pnct"));
     world_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+    
+    for (Scene::Instanced *instanced: {&player_instanced, &sheep_instanced}) {
+        instanced->program = lit_color_texture_instanced_program->program;
+        glGenBuffers(1, &instanced->buffer);
+        instanced->vao = ret->make_vao_for_program(instanced->program, instanced->buffer);
+        instanced->WORLD_TO_CLIP_mat4 = lit_color_texture_instanced_program->WORLD_TO_CLIP_mat4;
+        instanced->WORLD_TO_LIGHT_mat4x3 = lit_color_texture_instanced_program->WORLD_TO_LIGHT_mat4x3;
+    }
     return ret;
 });
 
@@ -34,14 +45,17 @@ Load<Scene> world_scene(LoadTagDefault, []() -> Scene const * {
                 pipeline.type = mesh.type;
                 pipeline.start = mesh.start;
                 pipeline.count = mesh.count;
+                pipeline.min = mesh.min;
+                pipeline.max = mesh.max;
                 
                 if (transform->name == "Player") {
                     player_pipeline = pipeline;
+                    player_pipeline.instanced = &player_instanced;
                 } else if (transform->name == "Sheep") {
                     sheep_pipeline = pipeline;
+                    sheep_pipeline.instanced = &sheep_instanced;
                 } else {
-                    scene.drawables.emplace_back(transform);
-                    scene.drawables.back().pipeline = pipeline;
+                    scene.add_drawable(transform).pipeline = pipeline;
                 }
             });
 });
@@ -67,6 +81,9 @@ PlayMode::PlayMode(Client &client_) : client(client_), scene(*world_scene) {
     
     // start player walking at nearest walk point:
     player.at = game.walkmesh->nearest_walk_point(player.transform->position);
+    
+    // tell the server we understand the compact state encoding:
+    Game::send_hello_message(&client.connection);
 }
 
 PlayMode::~PlayMode() = default;
@@ -94,6 +111,9 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
         } else if (evt.key.keysym.sym == SDLK_ESCAPE) {
             SDL_SetRelativeMouseMode(SDL_FALSE);
             return true;
+        } else if (evt.key.keysym.sym == SDLK_F3) {
+            show_draw_stats = !show_draw_stats;
+            return true;
         }
     } else if (evt.type == SDL_KEYUP) {
         if (evt.key.keysym.sym == SDLK_a) {
@@ -159,12 +179,16 @@ void PlayMode::update(float elapsed) {
             throw std::runtime_error("Lost connection to server!");
         } else {
             assert(event == Connection::OnRecv);
-            //std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush(); //DEBUG
+            //std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer.data(), c->recv_buffer.size()); std::cout.flush(); //DEBUG
             bool handled_message;
             try {
                 do {
                     handled_message = false;
-                    if (game.recv_state_message(c)) handled_message = true;
+                    if (game.recv_state_message(c)) {
+                        //let the server know which state we have, so it can send the next one as changes from this one:
+                        game.send_ack_message(c);
+                        handled_message = true;
+                    }
                 } while (handled_message);
             } catch (std::exception const &e) {
                 std::cerr << "[" << c->socket << "] malformed message from server: " << e.what() << std::endl;
@@ -176,59 +200,52 @@ void PlayMode::update(float elapsed) {
     
     // Set my own position
     // The server always sends with the current player first
-    player.at = game.players.front().at;
+    player.at = game.players.at[0];
     player.transform->position = game.walkmesh->to_world_point(player.at);
-    player.transform->rotation = game.players.front().rotation;
+    player.transform->rotation = game.players.rotation[0];
     
-    // Draw the other players
-    // maybe it's a little slow to do this each frame - but whatever, computers are fast these days
-    scene.drawables.remove_if([](Scene::Drawable &drawable) {
-        return drawable.transform->name == "Player" || drawable.transform->name == "Sheep";
-    });
-    scene.transforms.remove_if([](Scene::Transform &transform) {
-        return transform.name == "Player" || transform.name == "Sheep";
-    });
+    // Draw the other players (and the sheep)
+    // their transforms and drawables stick around between frames; only joining and leaving adds or removes any
+    frame += 1;
     
-    for (Player &other: game.players) {
-        // only display players that aren't too close to myself, basic attempt to avoid ugliness of being inside other things
-        if (glm::distance(game.walkmesh->to_world_point(player.at), game.walkmesh->to_world_point(other.at))
-            > Game::PlayerRadius) {
-            scene.transforms.emplace_back();
-            Scene::Transform &transform = scene.transforms.back();
-            transform.name = "Player";
-            transform.position = game.walkmesh->to_world_point(other.at);
-            transform.rotation = other.rotation;
-            
-            scene.drawables.emplace_back(&transform);
-            Scene::Drawable &drawable = scene.drawables.back();
-            drawable.pipeline = player_pipeline;
+    for (size_t i = 0; i < game.players.size(); ++i) {
+        auto f = player_entities.find(game.players.id[i]);
+        if (f == player_entities.end()) {
+            f = player_entities.emplace(game.players.id[i], add_entity("Player", player_pipeline)).first;
         }
+        f->second.seen = frame;
+        place_entity(f->second, game.players.at[i], game.players.rotation[i]);
     }
-    
-    for (Sheep &sheep: game.sheeps) {
-        // only display sheep that aren't too close to myself, basic attempt to avoid ugliness of being inside other things
-        if (glm::distance(game.walkmesh->to_world_point(player.at), game.walkmesh->to_world_point(sheep.at))
-            > Game::PlayerRadius) {
-            scene.transforms.emplace_back();
-            Scene::Transform &transform = scene.transforms.back();
-            transform.name = "Sheep";
-            transform.position = game.walkmesh->to_world_point(sheep.at);
-            transform.rotation = sheep.rotation;
-            
-            scene.drawables.emplace_back(&transform);
-            Scene::Drawable &drawable = scene.drawables.back();
-            drawable.pipeline = sheep_pipeline;
+    // players that weren't in this state have left:
+    for (auto e = player_entities.begin(); e != player_entities.end(); /*later*/) {
+        if (e->second.seen != frame) {
+            remove_entity(e->second);
+            e = player_entities.erase(e);
+        } else {
+            ++e;
         }
     }
     
+    // (sheep never come or go once the game has started, but the first state may not have arrived yet)
+    while (sheep_entities.size() < game.sheeps.size()) {
+        sheep_entities.emplace_back(add_entity("Sheep", sheep_pipeline));
+    }
+    while (sheep_entities.size() > game.sheeps.size()) {
+        remove_entity(sheep_entities.back());
+        sheep_entities.pop_back();
+    }
+    for (size_t i = 0; i < game.sheeps.size(); ++i) {
+        place_entity(sheep_entities[i], game.sheeps.at[i], game.sheeps.rotation[i]);
+    }
+    
     float max_distance = 0;
-    for (Sheep &sheep: game.sheeps) {
-        for (Sheep &other: game.sheeps) {
+    for (WalkPoint const &sheep_at: game.sheeps.at) {
+        for (WalkPoint const &other_at: game.sheeps.at) {
             max_distance = glm::max(
                     max_distance,
                     glm::distance(
-                            game.walkmesh->to_world_point(sheep.at),
-                            game.walkmesh->to_world_point(other.at)
+                            game.walkmesh->to_world_point(sheep_at),
+                            game.walkmesh->to_world_point(other_at)
                     )
             );
         }
@@ -241,16 +258,43 @@ void PlayMode::update(float elapsed) {
     );
 }
 
+PlayMode::Entity PlayMode::add_entity(std::string const &name, Scene::Drawable::Pipeline const &pipeline) {
+    Entity entity;
+    
+    scene.transforms.emplace_back();
+    entity.transform = std::prev(scene.transforms.end());
+    entity.transform->name = name;
+    
+    scene.add_drawable(&*entity.transform, true).pipeline = pipeline;
+    entity.drawable = std::prev(scene.drawables.end());
+    
+    return entity;
+}
+
+void PlayMode::remove_entity(Entity const &entity) {
+    scene.remove_drawable(entity.drawable);
+    scene.transforms.erase(entity.transform);
+}
+
+void PlayMode::place_entity(Entity const &entity, WalkPoint const &at, glm::quat const &rotation) {
+    entity.transform->position = game.walkmesh->to_world_point(at);
+    entity.transform->rotation = rotation;
+    // only display things that aren't too close to myself, basic attempt to avoid ugliness of being inside other things
+    entity.drawable->visible = (glm::distance(player.transform->position, entity.transform->position) > Game::PlayerRadius);
+}
+
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
     // taken from game5 base code
     // update camera aspect ratio for drawable:
     player.camera->aspect = float(drawable_size.x) / float(drawable_size.y);
     
-    //set up light type and position for lit_color_texture_program:
-    glUseProgram(lit_color_texture_program->program);
-    glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-    glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, -1.0f)));
-    glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+    //set up light type and position for lit_color_texture_program (and its instanced variant):
+    for (LitColorTextureProgram const *program: {&*lit_color_texture_program, &*lit_color_texture_instanced_program}) {
+        glUseProgram(program->program);
+        glUniform1i(program->LIGHT_TYPE_int, 1);
+        glUniform3fv(program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f, -1.0f)));
+        glUniform3fv(program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+    }
     glUseProgram(0);
     
     glClearColor(color.r, color.g, color.b, 1.0f);
@@ -262,5 +306,30 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
     
     scene.draw(*player.camera);
     
+    if (show_draw_stats) {
+        Scene::DrawStats const &stats = scene.draw_stats;
+        std::string text = std::to_string(stats.drawables) + " drawn, "
+                           + std::to_string(stats.culled) + " culled, "
+                           + std::to_string(stats.draw_calls) + " draw calls, "
+                           + std::to_string(stats.program_switches) + " programs, "
+                           + std::to_string(stats.vao_binds) + " vaos, "
+                           + std::to_string(stats.texture_binds) + " textures";
+        
+        // text in the top left corner, drawn in a [-aspect,aspect]x[-1,1] screen space:
+        glDisable(GL_DEPTH_TEST);
+        float aspect = float(drawable_size.x) / float(drawable_size.y);
+        DrawLines lines(glm::mat4(
+                glm::vec4(1.0f / aspect, 0.0f, 0.0f, 0.0f),
+                glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+                glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
+        ));
+        constexpr float H = 0.05f;
+        lines.draw_text(text,
+                        glm::vec3(-aspect + 0.5f * H, 1.0f - 1.5f * H, 0.0f),
+                        glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+                        glm::u8vec4(0xff, 0xff, 0xff, 0xff));
+    }
+    
     GL_ERRORS();
 }
@@ -12,6 +12,8 @@
 
 #include <vector>
 #include <deque>
+#include <list>
+#include <unordered_map>
 
 struct PlayMode : Mode {
     explicit PlayMode(Client &client);
@@ -52,4 +54,24 @@ struct PlayMode : Mode {
     } player;
     
     Scene scene;
+    
+    // F3 toggles an overlay with what drawing the scene cost (see Scene::DrawStats):
+    bool show_draw_stats = false;
+    
+    // other players and sheep in the scene, kept from frame to frame (players by server id, sheep by index),
+    // so that a frame where nobody joins or leaves just moves transforms around and doesn't allocate:
+    struct Entity {
+        std::list<Scene::Transform>::iterator transform;
+        std::list<Scene::Drawable>::iterator drawable;
+        uint32_t seen = 0; // (players) last frame the player was in the game state
+    };
+    std::unordered_map<uint32_t, Entity> player_entities;
+    std::vector<Entity> sheep_entities;
+    uint32_t frame = 0;
+    
+    Entity add_entity(std::string const &name, Scene::Drawable::Pipeline const &pipeline);
+    void remove_entity(Entity const &entity);
+    
+    // move an entity to where the game state says it is (hiding it if it's right on top of the camera):
+    void place_entity(Entity const &entity, WalkPoint const &at, glm::quat const &rotation);
 };
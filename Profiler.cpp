@@ -0,0 +1,133 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <cstdio>
+
+char const *Profiler::name(Phase phase) {
+    switch (phase) {
+        case Poll: return "poll";
+        case Decode: return "decode";
+        case Players: return "players";
+        case Sheep: return "sheep";
+        case Encode: return "encode";
+        case Flush: return "flush";
+        case Tick: return "tick";
+        default: return "?";
+    }
+}
+
+char const *Profiler::name(Counter counter) {
+    switch (counter) {
+        case Overruns: return "overruns";
+        case CatchUpSteps: return "catch-up steps";
+        case DroppedTicks: return "dropped ticks";
+        case DegradedSends: return "degraded sends";
+        default: return "?";
+    }
+}
+
+void Profiler::count(Counter counter, uint64_t n) {
+    counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+void Profiler::add(Phase phase, double seconds, uint64_t bytes_) {
+    tick_ns[phase].fetch_add(uint64_t(seconds * 1e9), std::memory_order_relaxed);
+    if (bytes_) bytes[phase].fetch_add(bytes_, std::memory_order_relaxed);
+}
+
+void Profiler::end_tick() {
+    for (uint32_t p = 0; p < PhaseCount; ++p) {
+        histograms[p].record(tick_ns[p].exchange(0, std::memory_order_relaxed) / 1000);
+    }
+    ticks.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint32_t Profiler::Histogram::bucket(uint64_t us) {
+    if (us < SubBuckets) return uint32_t(us);
+    //position of the highest set bit (at least 3, since us >= 8):
+    uint32_t top = 63;
+    while (!(us >> top)) --top;
+    //8 buckets for each power of two, split by the three bits below the top one:
+    return (top - 2) * SubBuckets + uint32_t((us >> (top - 3)) & (SubBuckets - 1));
+}
+
+uint64_t Profiler::Histogram::bucket_min(uint32_t bucket) {
+    if (bucket < SubBuckets) return bucket;
+    uint32_t top = bucket / SubBuckets + 2;
+    return uint64_t(SubBuckets + bucket % SubBuckets) << (top - 3);
+}
+
+void Profiler::Histogram::record(uint64_t us) {
+    counts[std::min(bucket(us), Buckets - 1)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t seen = max.load(std::memory_order_relaxed);
+    while (us > seen && !max.compare_exchange_weak(seen, us, std::memory_order_relaxed)) { }
+}
+
+void Profiler::write(std::ostream &out) {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - window_start).count();
+    window_start = now;
+    uint64_t window_ticks = ticks.exchange(0);
+
+    out << "# " << window_ticks << " ticks in the last " << std::fixed << std::setprecision(1) << seconds << "s:";
+    for (uint32_t c = 0; c < CounterCount; ++c) {
+        out << (c ? ", " : " ") << counters[c].exchange(0, std::memory_order_relaxed) << " " << name(Counter(c));
+    }
+    out << "\n# times in ms per tick\n";
+    out << std::left << std::setw(10) << "phase" << std::right
+        << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "max"
+        << std::setw(14) << "bytes" << std::setw(12) << "KiB/s" << "\n";
+
+    for (uint32_t p = 0; p < PhaseCount; ++p) {
+        Histogram &histogram = histograms[p];
+
+        //take (and reset) the counts, then walk them to find the percentiles:
+        std::array<uint64_t, Histogram::Buckets> counts;
+        uint64_t total = 0;
+        for (uint32_t b = 0; b < Histogram::Buckets; ++b) {
+            counts[b] = histogram.counts[b].exchange(0, std::memory_order_relaxed);
+            total += counts[b];
+        }
+        uint64_t max = histogram.max.exchange(0, std::memory_order_relaxed);
+        auto percentile = [&](double fraction) -> double {
+            if (total == 0) return 0.0;
+            auto rank = uint64_t(fraction * double(total - 1));
+            uint64_t seen = 0;
+            for (uint32_t b = 0; b < Histogram::Buckets; ++b) {
+                seen += counts[b];
+                if (seen > rank) return double(Histogram::bucket_min(b)) / 1000.0;
+            }
+            return double(max) / 1000.0;
+        };
+        uint64_t phase_bytes = bytes[p].exchange(0, std::memory_order_relaxed);
+
+        out << std::left << std::setw(10) << name(Phase(p)) << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << percentile(0.5) << std::setw(10) << percentile(0.99) << std::setw(10) << double(max) / 1000.0;
+        if (phase_bytes) {
+            out << std::setw(14) << phase_bytes << std::setw(12) << std::setprecision(1)
+                << (seconds > 0.0 ? double(phase_bytes) / 1024.0 / seconds : 0.0);
+        }
+        out << "\n";
+    }
+    out.flush();
+}
+
+void Profiler::write(std::string const &filename) {
+    std::string temp = filename + "." + std::to_string(std::random_device()()) + ".tmp";
+    {
+        std::ofstream out(temp);
+        if (!out) throw std::runtime_error("Failed to open '" + temp + "' for writing.");
+        write(out);
+    }
+#ifdef _WIN32
+    std::remove(filename.c_str()); //(rename won't replace a file on windows)
+#endif
+    if (std::rename(temp.c_str(), filename.c_str()) != 0) {
+        std::remove(temp.c_str());
+        throw std::runtime_error("Failed to rename '" + temp + "' to '" + filename + "'");
+    }
+}
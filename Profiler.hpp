@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+ * Profiler keeps track of where each server tick's time goes:
+ *
+ *  Profiler profiler;
+ *  game.profiler = &profiler; //Game::update times its player and sheep phases
+ *  {
+ *      Profiler::Scope scope(&profiler, Profiler::Encode); //time a block (a null profiler is fine, and does nothing)
+ *      ...
+ *  }
+ *  profiler.add(Profiler::Poll, seconds, bytes); //or add time (and bytes) directly
+ *  profiler.count(Profiler::Overruns); //bump a counter
+ *  profiler.end_tick(); //once per tick: files this tick's per-phase totals into the histograms
+ *  profiler.write(std::cout); //p50/p99/max per phase and counter totals since the last write (and starts a new window)
+ *
+ * Everything is lock-free (atomic counters), so phases can be added to from
+ * several threads at once -- e.g., matches updating on a worker pool. With
+ * several matches, a phase's time is summed over all of them, so it is CPU
+ * time, and the phases can add up to more than the tick took.
+ *
+ * Histograms have 8 buckets per power of two microseconds, so percentiles are
+ * within about 12% (and rounded down); maxima are exact.
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <cstdint>
+
+struct Profiler {
+    enum Phase : uint32_t {
+        Poll, //socket work: accepting, reading, closing (not counting time spent blocked waiting, or Decode)
+        Decode, //handling client messages (recv_controls_message and friends)
+        Players, //Game::update, player part
+        Sheep, //Game::update, sheep part
+        Encode, //recording the tick's snapshot, and send_state_message for each client
+        Flush, //sending the encoded states out
+        Tick, //all of the above, end to end
+        PhaseCount
+    };
+    static char const *name(Phase phase);
+
+    //things worth counting that aren't phases (see TickScheduler and MatchManager):
+    enum Counter : uint32_t {
+        Overruns, //ticks whose work went past when the next tick was due
+        CatchUpSteps, //extra simulation steps run to catch up
+        DroppedTicks, //ticks given up on for being too far behind
+        DegradedSends, //states not sent to lagging clients
+        CounterCount
+    };
+    static char const *name(Counter counter);
+    void count(Counter counter, uint64_t n = 1);
+
+    //add time (and bytes) to a phase for the current tick:
+    void add(Phase phase, double seconds, uint64_t bytes = 0);
+
+    //times a block:
+    struct Scope {
+        Scope(Profiler *profiler_, Phase phase_) : profiler(profiler_), phase(phase_) {
+            if (profiler) start = std::chrono::steady_clock::now();
+        }
+        ~Scope() {
+            if (profiler) profiler->add(phase, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        Scope(Scope const &) = delete;
+        Scope &operator=(Scope const &) = delete;
+
+        Profiler *profiler;
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    //file the current tick's per-phase times into the histograms (and start the next tick):
+    void end_tick();
+
+    //write a table of what happened since the last write (and start over):
+    void write(std::ostream &out);
+
+    //write to 'filename', via a temporary file, so that whatever reads it never sees half a table:
+    void write(std::string const &filename);
+
+    struct Histogram {
+        inline static constexpr uint32_t SubBuckets = 8; //(per power of two)
+        inline static constexpr uint32_t Buckets = (64 - 2) * SubBuckets;
+
+        static uint32_t bucket(uint64_t us);
+        static uint64_t bucket_min(uint32_t bucket); //smallest value that lands in 'bucket'
+
+        void record(uint64_t us);
+
+        std::array<std::atomic<uint64_t>, Buckets> counts{};
+        std::atomic<uint64_t> max{0};
+    };
+
+    //the current tick's totals (nanoseconds):
+    std::array<std::atomic<uint64_t>, PhaseCount> tick_ns{};
+
+    //since the last write:
+    std::array<Histogram, PhaseCount> histograms;
+    std::array<std::atomic<uint64_t>, PhaseCount> bytes{};
+    std::array<std::atomic<uint64_t>, CounterCount> counters{};
+    std::atomic<uint64_t> ticks{0};
+    std::chrono::steady_clock::time_point window_start = std::chrono::steady_clock::now();
+};
@@ -6,6 +6,9 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <fstream>
+#include <algorithm>
+#include <array>
+#include <cmath>
 
 //-------------------------
 
@@ -74,6 +77,68 @@ glm::mat4x3 Scene::Transform::make_world_to_local() const {
     }
 }
 
+void Scene::update_transforms() const {
+    //put transforms in order, parents first:
+    transform_pass += 1;
+    transform_order.clear();
+    for (auto const &transform: transforms) {
+        //(walk up to the first ancestor already placed, then place that chain from the top down)
+        size_t chain = transform_order.size();
+        for (Transform const *t = &transform; t && t->cache.pass != transform_pass; t = t->parent) {
+            t->cache.pass = transform_pass;
+            transform_order.push_back(t);
+        }
+        std::reverse(transform_order.begin() + chain, transform_order.end());
+    }
+    
+    //recompute matrices for transforms that changed (or whose parent did):
+    for (Transform const *t: transform_order) {
+        Transform::Cache &cache = t->cache;
+        Transform const *parent = t->parent;
+        if (cache.generation != 0
+            && t->position == cache.position && t->rotation == cache.rotation && t->scale == cache.scale
+            && parent == cache.parent && (!parent || parent->cache.generation == cache.parent_generation)) {
+            continue;
+        }
+        
+        cache.position = t->position;
+        cache.rotation = t->rotation;
+        cache.scale = t->scale;
+        cache.parent = parent;
+        
+        if (!parent) {
+            cache.local_to_world = t->make_local_to_parent();
+            cache.world_to_local = t->make_parent_to_local();
+            cache.parent_generation = 0;
+        } else {
+            cache.local_to_world = parent->cache.local_to_world * glm::mat4(t->make_local_to_parent());
+            cache.world_to_local = t->make_parent_to_local() * glm::mat4(parent->cache.world_to_local);
+            cache.parent_generation = parent->cache.generation;
+        }
+        cache.normal_to_world = glm::inverse(glm::transpose(glm::mat3(cache.local_to_world)));
+        
+        cache.generation += 1;
+        if (cache.generation == 0) cache.generation = 1; //(0 is reserved for 'never computed')
+        
+        //(a static drawable moved, so the BVH needs rebuilding)
+        if (cache.static_drawable) drawables_version += 1;
+    }
+}
+
+//-------------------------
+
+Scene::Drawable &Scene::add_drawable(Transform *transform, bool dynamic) {
+    drawables.emplace_back(transform);
+    drawables.back().dynamic = dynamic;
+    drawables_changed();
+    return drawables.back();
+}
+
+void Scene::remove_drawable(std::list<Drawable>::iterator drawable) {
+    drawables.erase(drawable);
+    drawables_changed();
+}
+
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
@@ -90,77 +155,360 @@ void Scene::draw(Camera const &camera) const {
     draw(world_to_clip, world_to_light);
 }
 
+//render queue sort key -- program, then vao, then (a hash of) textures:
+// (GL names are small numbers in practice; if they ever collide here, it only costs some extra state changes)
+static uint64_t render_key(GLuint program, GLuint vao, Scene::Drawable::Pipeline const &pipeline) {
+    uint32_t textures = 0;
+    for (auto const &texture: pipeline.textures) {
+        textures = textures * 31 + texture.texture;
+    }
+    return (uint64_t(program & 0xffff) << 48) | (uint64_t(vao & 0xffff) << 32) | uint64_t(textures);
+}
+
+//-- culling --
+
+//view frustum, as planes (xyz: inward-facing normal, w: offset) read off the rows of world_to_clip:
+// (just left, right, bottom, top, and near: Camera::make_projection is infinite, so has no far plane)
+struct Frustum {
+    explicit Frustum(glm::mat4 const &world_to_clip) {
+        auto row = [&](int r) {
+            return glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+        };
+        planes[0] = row(3) + row(0);
+        planes[1] = row(3) - row(0);
+        planes[2] = row(3) + row(1);
+        planes[3] = row(3) - row(1);
+        planes[4] = row(3) + row(2);
+    }
+    
+    //is the box entirely on the outside of some plane?
+    bool outside(glm::vec3 const &min, glm::vec3 const &max) const {
+        glm::vec3 center = 0.5f * (max + min);
+        glm::vec3 radius = 0.5f * (max - min);
+        for (auto const &plane: planes) {
+            glm::vec3 normal = glm::vec3(plane);
+            float reach = std::abs(normal.x) * radius.x + std::abs(normal.y) * radius.y + std::abs(normal.z) * radius.z;
+            if (glm::dot(normal, center) + plane.w + reach < 0.0f) return true;
+        }
+        return false;
+    }
+    
+    std::array<glm::vec4, 5> planes;
+};
+
+static bool has_bounds(Scene::Drawable const &drawable) {
+    Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+    return pipeline.min.x <= pipeline.max.x && pipeline.min.y <= pipeline.max.y && pipeline.min.z <= pipeline.max.z;
+}
+
+//recompute a drawable's world bounds if its transform has changed since they were computed:
+static void update_world_bounds(Scene::Drawable const &drawable) {
+    Scene::Transform::Cache const &cache = drawable.transform->cache;
+    Scene::Drawable::WorldBounds &bounds = drawable.world_bounds;
+    if (bounds.generation == cache.generation) return;
+    
+    //(the box around a transformed box: transform the center, and reach as far as the transformed axes do)
+    glm::vec3 center = 0.5f * (drawable.pipeline.max + drawable.pipeline.min);
+    glm::vec3 radius = 0.5f * (drawable.pipeline.max - drawable.pipeline.min);
+    glm::mat4x3 const &m = cache.local_to_world;
+    glm::vec3 world_center = m * glm::vec4(center, 1.0f);
+    glm::vec3 world_radius = glm::abs(m[0]) * radius.x + glm::abs(m[1]) * radius.y + glm::abs(m[2]) * radius.z;
+    
+    bounds.min = world_center - world_radius;
+    bounds.max = world_center + world_radius;
+    bounds.generation = cache.generation;
+}
+
+//build a node over static_bvh.items [begin,end) (and, below it, its children); returns its index:
+static uint32_t build_bvh_node(Scene::StaticBVH &bvh, uint32_t begin, uint32_t end) {
+    uint32_t index = uint32_t(bvh.nodes.size());
+    bvh.nodes.emplace_back();
+    
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::infinity());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::infinity());
+    glm::vec3 center_min = min;
+    glm::vec3 center_max = max;
+    for (uint32_t i = begin; i < end; ++i) {
+        Scene::StaticBVH::Item const &item = bvh.items[i];
+        min = glm::min(min, item.drawable->world_bounds.min);
+        max = glm::max(max, item.drawable->world_bounds.max);
+        center_min = glm::min(center_min, item.center);
+        center_max = glm::max(center_max, item.center);
+    }
+    
+    uint32_t right = 0;
+    if (end - begin > Scene::StaticBVH::LeafSize) {
+        //split at the median along whichever axis the centers are most spread out on:
+        glm::vec3 spread = center_max - center_min;
+        int axis = (spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2));
+        uint32_t mid = begin + (end - begin) / 2;
+        std::nth_element(bvh.items.begin() + begin, bvh.items.begin() + mid, bvh.items.begin() + end,
+                         [axis](Scene::StaticBVH::Item const &a, Scene::StaticBVH::Item const &b) {
+                             return a.center[axis] < b.center[axis];
+                         });
+        build_bvh_node(bvh, begin, mid); //(lands at index + 1)
+        right = build_bvh_node(bvh, mid, end);
+    }
+    
+    bvh.nodes[index] = Scene::StaticBVH::Node{min, max, begin, end, right};
+    return index;
+}
+
+//call 'visit' for each static drawable whose bounds aren't entirely outside the frustum (counting the others in 'culled'):
+template<typename F>
+static void cull_bvh_node(Scene::StaticBVH const &bvh, uint32_t index, Frustum const &frustum, uint32_t &culled, F const &visit) {
+    Scene::StaticBVH::Node const &node = bvh.nodes[index];
+    if (frustum.outside(node.min, node.max)) {
+        culled += node.end - node.begin;
+        return;
+    }
+    if (node.right == 0) {
+        for (uint32_t i = node.begin; i < node.end; ++i) {
+            Scene::Drawable const &drawable = *bvh.items[i].drawable;
+            update_world_bounds(drawable);
+            if (frustum.outside(drawable.world_bounds.min, drawable.world_bounds.max)) {
+                culled += 1;
+            } else {
+                visit(drawable);
+            }
+        }
+    } else {
+        cull_bvh_node(bvh, index + 1, frustum, culled, visit);
+        cull_bvh_node(bvh, node.right, frustum, culled, visit);
+    }
+}
+
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+    draw_stats = DrawStats();
     
-    //Iterate through all drawables, sending each one to OpenGL:
-    for (auto const &drawable: drawables) {
+    update_transforms();
+    
+    //normals go to light space via the (cached) normal-to-world matrix, then this:
+    // (inverse transpose of a product is the product of the inverse transposes)
+    glm::mat3 normal_world_to_light = glm::inverse(glm::transpose(glm::mat3(world_to_light)));
+    
+    Frustum frustum(world_to_clip);
+    
+    //is there anything to draw?
+    auto drawable_ready = [](Drawable const &drawable) {
         //Reference to drawable's pipeline for convenience:
         Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
         
+        //skip any drawables that are hidden:
+        if (!drawable.visible) return false;
         //skip any drawables without a shader program set:
-        if (pipeline.program == 0) continue;
+        if (pipeline.program == 0) return false;
         //skip any drawables that don't reference any vertex array:
-        if (pipeline.vao == 0) continue;
+        if (pipeline.vao == 0) return false;
         //skip any drawables that don't contain any vertices:
-        if (pipeline.count == 0) continue;
-        
-        
-        //Set shader program:
-        glUseProgram(pipeline.program);
-        
-        //Set attribute sources:
-        glBindVertexArray(pipeline.vao);
+        if (pipeline.count == 0) return false;
         
-        //Configure program uniforms:
-        
-        //the object-to-world matrix is used in all three of these uniforms:
         assert(drawable.transform); //drawables *must* have a transform
-        glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+        return true;
+    };
+    
+    //add a drawable to the render queue (or its instance batch):
+    auto submit = [&](Drawable const &drawable) {
+        Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
         
-        //OBJECT_TO_CLIP takes vertices from object space to clip space:
-        if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-            glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-            glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+        //instanced drawables are gathered up into batches, which are queued below:
+        if (pipeline.instanced) {
+            InstanceBatch &batch = instance_batches[pipeline.instanced];
+            if (batch.instances.empty()) {
+                batch.instanced = pipeline.instanced;
+                batch.pipeline = &pipeline;
+            }
+            
+            batch.instances.push_back(Instance{
+                    drawable.transform->cache.local_to_world,
+                    normal_world_to_light * drawable.transform->cache.normal_to_world
+            });
+            return;
         }
         
-        //the object-to-light matrix is used in the next two uniforms:
-        glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
-        
-        //OBJECT_TO_CLIP takes vertices from object space to light space:
-        if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-            glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+        render_queue.push_back(RenderItem{render_key(pipeline.program, pipeline.vao, pipeline), &drawable, nullptr});
+    };
+    
+    //Gather up everything that should be drawn:
+    render_queue.clear();
+    
+    //(re)build the culling lists if drawables have been added, removed, or static ones moved:
+    if (static_bvh.version != drawables_version) {
+        static_bvh.items.clear();
+        static_bvh.unbounded.clear();
+        static_bvh.nodes.clear();
+        static_bvh.dynamic.clear();
+        for (auto const &transform: transforms) {
+            transform.cache.static_drawable = false;
         }
-        
-        //NORMAL_TO_CLIP takes normals from object space to light space:
-        if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-            glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-            glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+        for (auto const &drawable: drawables) {
+            if (drawable.dynamic) {
+                static_bvh.dynamic.push_back(&drawable);
+            } else if (has_bounds(drawable)) {
+                update_world_bounds(drawable);
+                static_bvh.items.push_back(StaticBVH::Item{&drawable, 0.5f * (drawable.world_bounds.min + drawable.world_bounds.max)});
+                drawable.transform->cache.static_drawable = true;
+            } else {
+                static_bvh.unbounded.push_back(&drawable);
+            }
         }
-        
-        //set any requested custom uniforms:
-        if (pipeline.set_uniforms) pipeline.set_uniforms();
-        
-        //set up textures:
-        for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-            if (pipeline.textures[i].texture != 0) {
-                glActiveTexture(GL_TEXTURE0 + i);
-                glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+        if (!static_bvh.items.empty()) build_bvh_node(static_bvh, 0, uint32_t(static_bvh.items.size()));
+        static_bvh.version = drawables_version;
+    }
+    
+    //dynamic drawables are culled one at a time:
+    for (Drawable const *drawable: static_bvh.dynamic) {
+        if (!drawable_ready(*drawable)) continue;
+        if (has_bounds(*drawable)) {
+            update_world_bounds(*drawable);
+            if (frustum.outside(drawable->world_bounds.min, drawable->world_bounds.max)) {
+                draw_stats.culled += 1;
+                continue;
             }
         }
-        
-        //draw the object:
-        glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
-        
-        //un-bind textures:
+        submit(*drawable);
+    }
+    
+    //static ones through the BVH:
+    for (Drawable const *drawable: static_bvh.unbounded) {
+        if (drawable_ready(*drawable)) submit(*drawable);
+    }
+    if (!static_bvh.nodes.empty()) {
+        cull_bvh_node(static_bvh, 0, frustum, draw_stats.culled, [&](Drawable const &drawable) {
+            if (drawable_ready(drawable)) submit(drawable);
+        });
+    }
+    
+    for (auto &[instanced, batch]: instance_batches) {
+        if (batch.instances.empty()) continue;
+        render_queue.push_back(RenderItem{render_key(instanced->program, instanced->vao, *batch.pipeline), nullptr, &batch});
+    }
+    
+    std::sort(render_queue.begin(), render_queue.end(), [](RenderItem const &a, RenderItem const &b) {
+        return a.key < b.key;
+    });
+    
+    //State changes are only sent to OpenGL when something actually changes:
+    GLuint bound_program = 0;
+    GLuint bound_vao = 0;
+    Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+    GLuint active_texture = 0;
+    
+    auto bind = [&](GLuint program, GLuint vao, Drawable::Pipeline const &pipeline) {
+        if (program != bound_program) {
+            glUseProgram(program);
+            bound_program = program;
+            draw_stats.program_switches += 1;
+        }
+        if (vao != bound_vao) {
+            glBindVertexArray(vao);
+            bound_vao = vao;
+            draw_stats.vao_binds += 1;
+        }
         for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-            if (pipeline.textures[i].texture != 0) {
+            Drawable::Pipeline::TextureInfo const &texture = pipeline.textures[i];
+            Drawable::Pipeline::TextureInfo &bound = bound_textures[i];
+            if (texture.texture == bound.texture && (texture.texture == 0 || texture.target == bound.target)) continue;
+            
+            if (active_texture != i) {
                 glActiveTexture(GL_TEXTURE0 + i);
-                glBindTexture(pipeline.textures[i].target, 0);
+                active_texture = i;
             }
+            if (texture.texture == 0) {
+                //(an empty slot gets nothing bound, not whatever an earlier draw left there)
+                glBindTexture(bound.target, 0);
+                bound = Drawable::Pipeline::TextureInfo();
+            } else {
+                //(a texture left on another target of this unit would still be bound there, so clear it)
+                if (bound.texture != 0 && bound.target != texture.target) {
+                    glBindTexture(bound.target, 0);
+                }
+                glBindTexture(texture.target, texture.texture);
+                bound = texture;
+            }
+            draw_stats.texture_binds += 1;
+        }
+    };
+    
+    for (RenderItem const &item: render_queue) {
+        if (item.drawable) {
+            Scene::Drawable const &drawable = *item.drawable;
+            Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+            
+            bind(pipeline.program, pipeline.vao, pipeline);
+            
+            //Configure program uniforms:
+            
+            //the object-to-world matrix is used in all three of these uniforms:
+            glm::mat4x3 const &object_to_world = drawable.transform->cache.local_to_world;
+            
+            //OBJECT_TO_CLIP takes vertices from object space to clip space:
+            if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
+                glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+                glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+            }
+            
+            //the object-to-light matrix is used in the next two uniforms:
+            glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+            
+            //OBJECT_TO_CLIP takes vertices from object space to light space:
+            if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
+                glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+            }
+            
+            //NORMAL_TO_CLIP takes normals from object space to light space:
+            if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
+                glm::mat3 normal_to_light = normal_world_to_light * drawable.transform->cache.normal_to_world;
+                glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+            }
+            
+            //set any requested custom uniforms:
+            if (pipeline.set_uniforms) pipeline.set_uniforms();
+            
+            //draw the object:
+            glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+            draw_stats.draw_calls += 1;
+            draw_stats.drawables += 1;
+        } else {
+            //draw a whole batch of instanced drawables with one call:
+            InstanceBatch &batch = *item.batch;
+            Scene::Instanced const &instanced = *batch.instanced;
+            Scene::Drawable::Pipeline const &pipeline = *batch.pipeline;
+            
+            bind(instanced.program, instanced.vao, pipeline);
+            
+            //stream this draw's instances (re-specifying the whole buffer, so the driver can hand out fresh storage
+            // rather than waiting for the last draw to finish with the old one):
+            glBindBuffer(GL_ARRAY_BUFFER, instanced.buffer);
+            glBufferData(GL_ARRAY_BUFFER, batch.instances.size() * sizeof(Instance), batch.instances.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            
+            if (instanced.WORLD_TO_CLIP_mat4 != -1U) {
+                glUniformMatrix4fv(instanced.WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+            }
+            if (instanced.WORLD_TO_LIGHT_mat4x3 != -1U) {
+                glUniformMatrix4x3fv(instanced.WORLD_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(world_to_light));
+            }
+            
+            if (pipeline.set_uniforms) pipeline.set_uniforms();
+            
+            glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, GLsizei(batch.instances.size()));
+            draw_stats.draw_calls += 1;
+            draw_stats.drawables += uint32_t(batch.instances.size());
+            
+            //(keeps its capacity for next time)
+            batch.instances.clear();
+        }
+    }
+    
+    //un-bind textures (once, at the end):
+    for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+        if (bound_textures[i].texture != 0) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(bound_textures[i].target, 0);
         }
-        glActiveTexture(GL_TEXTURE0);
-        
     }
+    glActiveTexture(GL_TEXTURE0);
     
     glUseProgram(0);
     glBindVertexArray(0);
@@ -375,7 +723,10 @@ void Scene::set(Scene const &other, std::unordered_map<Transform const *, Transf
     drawables = other.drawables;
     for (auto &d: drawables) {
         d.transform = transform_to_transform.at(d.transform);
+        d.world_bounds = Drawable::WorldBounds(); //(were for other's transforms)
     }
+    static_bvh = StaticBVH();
+    drawables_changed();
     
     //copy other's cameras, updating transform pointers:
     cameras = other.cameras;
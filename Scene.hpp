@@ -15,6 +15,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
@@ -46,6 +47,25 @@ struct Scene {
         
         glm::mat4x3 make_world_to_local() const;
         
+        //..or use the cached ones kept up to date by Scene::update_transforms():
+        // (along with the position/rotation/scale/parent they came from, so changes are spotted without needing setters)
+        struct Cache {
+            glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+            glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+            glm::mat3 normal_to_world = glm::mat3(1.0f); //inverse transpose of local_to_world's upper 3x3
+            uint32_t generation = 0; //bumped whenever the matrices change (0 => never computed)
+            
+            glm::vec3 position = glm::vec3(0.0f);
+            glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+            glm::vec3 scale = glm::vec3(1.0f);
+            Transform const *parent = nullptr;
+            uint32_t parent_generation = 0; //parent's generation when the matrices were computed
+            
+            uint32_t pass = 0; //(used by update_transforms to put parents first)
+            bool static_drawable = false; //a static drawable is attached (so moving bumps Scene::drawables_version)
+        };
+        mutable Cache cache;
+        
         //since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
         Transform(Transform const &) = delete;
         
@@ -53,12 +73,44 @@ struct Scene {
         Transform() = default;
     };
     
+    //Drawables that share an 'Instanced' (e.g., a whole herd of sheep) are drawn together, with one glDrawArraysInstanced:
+    // draw() packs their matrices into 'buffer' (one Instance each, in a fresh buffer every draw) and draws their
+    // (shared) mesh once per instance with an instanced variant of their program.
+    struct Instance {
+        glm::mat4x3 object_to_world;
+        glm::mat3 normal_to_light;
+    };
+    struct Instanced {
+        GLuint program = 0; //takes ObjectToWorld (mat4x3) and NormalToLight (mat3) attributes from 'buffer' instead of per-object uniforms
+        GLuint vao = 0; //mesh attributes for 'program', plus the per-instance ones (see MeshBuffer::make_vao_for_program)
+        GLuint buffer = 0; //per-instance data; passed to glBufferData
+        
+        //uniforms:
+        GLuint WORLD_TO_CLIP_mat4 = -1U; //uniform location for world to clip space matrix
+        GLuint WORLD_TO_LIGHT_mat4x3 = -1U; //uniform location for world to light space matrix
+    };
+    
     struct Drawable {
         //a 'Drawable' attaches attribute data to a transform:
         explicit Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
         
         Transform *transform;
         
+        //draw() skips drawables that aren't visible (handy for hiding things without removing them):
+        bool visible = true;
+        
+        //drawables that move around should say so (see Scene::add_drawable); the rest are kept in a bounding volume
+        // hierarchy for culling (which still works if they do move, but is then rebuilt every draw they move in):
+        bool dynamic = false;
+        
+        //world-space bounds (from pipeline.min/max and the transform's cached matrix), kept up to date by draw():
+        struct WorldBounds {
+            glm::vec3 min = glm::vec3(0.0f);
+            glm::vec3 max = glm::vec3(0.0f);
+            uint32_t generation = 0; //transform cache generation they were computed for
+        };
+        mutable WorldBounds world_bounds;
+        
         //Contains all the data needed to run the OpenGL pipeline:
         struct Pipeline {
             GLuint program = 0; //shader program; passed to glUseProgram
@@ -70,6 +122,10 @@ struct Scene {
             GLuint start = 0; //first vertex to draw; passed to glDrawArrays
             GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
             
+            //object-space bounding box of those vertices, for culling (the default, empty box means "never cull"):
+            glm::vec3 min = glm::vec3(std::numeric_limits<float>::infinity());
+            glm::vec3 max = glm::vec3(-std::numeric_limits<float>::infinity());
+            
             //uniforms:
             GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
             GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
@@ -77,6 +133,9 @@ struct Scene {
             
             std::function<void()> set_uniforms; //(optional) function to set any other useful uniforms
             
+            //(optional) draw along with every other drawable with the same 'instanced' (their pipelines should otherwise match):
+            Instanced const *instanced = nullptr;
+            
             //texture objects to bind for the first TextureCount textures:
             enum : uint32_t {
                 TextureCount = 4
@@ -131,12 +190,84 @@ struct Scene {
     std::list<Camera> cameras;
     std::list<Light> lights;
     
+    //add and remove drawables with these, rather than through 'drawables' directly, so draw() knows to update its culling:
+    // (after changing 'drawables' -- or a drawable's 'dynamic' flag or pipeline bounds -- some other way, call drawables_changed())
+    Drawable &add_drawable(Transform *transform, bool dynamic = false);
+    void remove_drawable(std::list<Drawable>::iterator drawable);
+    void drawables_changed() const { drawables_version += 1; }
+    
+    //bumped when drawables are added or removed, or a static one moves (draw() rebuilds its culling lists when it changes):
+    mutable uint32_t drawables_version = 1;
+    
+    //bring every transform's cached matrices up to date (draw() does this itself):
+    // runs parents-before-children over a flat array; transforms whose local values and parent haven't changed
+    // since the last update (e.g., static level geometry) only cost a comparison, not a matrix product.
+    void update_transforms() const;
+    
     //The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
     void draw(Camera const &camera) const;
     
     //..sometimes, you want to draw with a custom projection matrix and/or light space:
     void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
     
+    //what the last draw() cost on the CPU side:
+    struct DrawStats {
+        uint32_t drawables = 0; //drawables drawn (counting each instance)
+        uint32_t culled = 0; //drawables skipped for being outside the view frustum
+        uint32_t draw_calls = 0; //glDrawArrays + glDrawArraysInstanced
+        uint32_t program_switches = 0; //glUseProgram
+        uint32_t vao_binds = 0; //glBindVertexArray
+        uint32_t texture_binds = 0; //glBindTexture
+    };
+    mutable DrawStats draw_stats;
+    
+    //-- internals used by draw() (kept between draws so their storage is reused) --
+    
+    //every transform, with parents before children (rebuilt by each update_transforms(), since the list may have changed):
+    mutable std::vector<Transform const *> transform_order;
+    mutable uint32_t transform_pass = 0;
+    
+    //static (not dynamic) drawables, in a bounding volume hierarchy (with the dynamic ones listed alongside):
+    struct StaticBVH {
+        struct Item {
+            Drawable const *drawable;
+            glm::vec3 center; //(of its world bounds; used for splitting)
+        };
+        std::vector<Item> items; //(in node order)
+        std::vector<Drawable const *> unbounded; //drawables without bounds (never culled)
+        
+        //nodes cover items [begin,end); children of node i are i + 1 and 'right' (leaves have right == 0):
+        struct Node {
+            glm::vec3 min, max;
+            uint32_t begin, end;
+            uint32_t right;
+        };
+        std::vector<Node> nodes;
+        inline static constexpr uint32_t LeafSize = 4;
+        
+        std::vector<Drawable const *> dynamic; //(culled one at a time)
+        
+        uint32_t version = 0; //drawables_version this was built for
+    };
+    mutable StaticBVH static_bvh;
+    
+    //instanced drawables, gathered up by their Instanced:
+    struct InstanceBatch {
+        Instanced const *instanced = nullptr;
+        Drawable::Pipeline const *pipeline = nullptr; //(of the first drawable in the batch)
+        std::vector<Instance> instances;
+    };
+    mutable std::unordered_map<Instanced const *, InstanceBatch> instance_batches;
+    
+    //everything to draw this time (a drawable or a whole batch each), sorted by program, vao, then textures,
+    // so that state only changes when it needs to:
+    struct RenderItem {
+        uint64_t key;
+        Drawable const *drawable; //(null for batches)
+        InstanceBatch *batch; //(null for drawables)
+    };
+    mutable std::vector<RenderItem> render_queue;
+    
     //add transforms/objects/cameras from a scene file to this scene:
     // the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
     // throws on file format errors
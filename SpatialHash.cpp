@@ -0,0 +1,37 @@
+#include "SpatialHash.hpp"
+
+#include <cassert>
+
+void SpatialHash::build(std::vector<glm::vec3> const &points) {
+    assert(cell_size > 0.0f);
+
+    //use (at least) twice as many buckets as points to keep unrelated cells from sharing buckets:
+    uint32_t bucket_count = 64;
+    while (bucket_count < 2 * points.size()) bucket_count *= 2;
+
+    bucket_start.assign(bucket_count + 1, 0);
+    point_bucket.resize(points.size());
+    entries.resize(points.size());
+
+    //counting sort by bucket -- first count points in each bucket:
+    for (size_t i = 0; i < points.size(); ++i) {
+        point_bucket[i] = bucket_of(cell_of(points[i]));
+        bucket_start[point_bucket[i] + 1] += 1;
+    }
+
+    //...then prefix sum to get where each bucket starts:
+    for (uint32_t b = 0; b < bucket_count; ++b) {
+        bucket_start[b + 1] += bucket_start[b];
+    }
+
+    //...then drop each point into place, using bucket_start[b] as a cursor:
+    for (size_t i = 0; i < points.size(); ++i) {
+        entries[bucket_start[point_bucket[i]]++] = Entry{uint32_t(i), points[i]};
+    }
+
+    //...which leaves each bucket_start[b] at the start of bucket b+1, so shift back:
+    for (uint32_t b = bucket_count; b > 0; --b) {
+        bucket_start[b] = bucket_start[b - 1];
+    }
+    bucket_start[0] = 0;
+}
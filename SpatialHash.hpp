@@ -0,0 +1,92 @@
+#pragma once
+
+/*
+ * A SpatialHash buckets world-space points into a uniform grid of cubic cells,
+ * so that "what's near this point?" only has to look at a handful of cells
+ * instead of every point.
+ *
+ * It is meant to be rebuilt from scratch (once per tick) rather than updated
+ * incrementally -- build() reuses its storage, so after the first few ticks it
+ * doesn't allocate.
+ *
+ * Usage:
+ *  SpatialHash grid(2.0f); //cell size should be the largest radius you'll query with
+ *  grid.build(positions);
+ *  grid.for_each_near(center, [&](uint32_t index, glm::vec3 const &position) {
+ *      //called for every point in the 3x3x3 block of cells around center
+ *      // (so the caller still needs to do its own distance check)
+ *  });
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+struct SpatialHash {
+    explicit SpatialHash(float cell_size_) : cell_size(cell_size_) {}
+
+    //edge length of a cell; queries are only exact for radii <= cell_size:
+    float cell_size;
+
+    //re-bucket all points (index i in for_each_near refers to points[i]):
+    void build(std::vector<glm::vec3> const &points);
+
+    //call fn(index, position) for every point in the 27 cells around center:
+    template<typename F>
+    void for_each_near(glm::vec3 const &center, F const &fn) const {
+        if (entries.empty()) return;
+        glm::ivec3 cell = cell_of(center);
+
+        //neighboring cells may hash to the same bucket, so only visit each bucket once:
+        std::array<uint32_t, 27> buckets;
+        uint32_t count = 0;
+        for (int dz = -1; dz <= 1; ++dz) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    buckets[count++] = bucket_of(cell + glm::ivec3(dx, dy, dz));
+                }
+            }
+        }
+        std::sort(buckets.begin(), buckets.end());
+
+        for (uint32_t b = 0; b < count; ++b) {
+            if (b > 0 && buckets[b] == buckets[b - 1]) continue;
+            for (uint32_t e = bucket_start[buckets[b]]; e != bucket_start[buckets[b] + 1]; ++e) {
+                fn(entries[e].index, entries[e].position);
+            }
+        }
+    }
+
+    //internals:
+    glm::ivec3 cell_of(glm::vec3 const &point) const {
+        return glm::ivec3(
+                int32_t(std::floor(point.x / cell_size)),
+                int32_t(std::floor(point.y / cell_size)),
+                int32_t(std::floor(point.z / cell_size))
+        );
+    }
+
+    uint32_t bucket_of(glm::ivec3 const &cell) const {
+        //the usual large-prime hash (Teschner et al. 2003):
+        return ((uint32_t(cell.x) * 73856093U) ^ (uint32_t(cell.y) * 19349663U) ^ (uint32_t(cell.z) * 83492791U))
+               & (uint32_t(bucket_start.size()) - 2U);
+    }
+
+    //points, sorted by bucket (a copy of the position is kept next to the index so queries don't hop around memory):
+    struct Entry {
+        uint32_t index;
+        glm::vec3 position;
+    };
+    std::vector<Entry> entries;
+
+    //entries in bucket b are entries[bucket_start[b]] .. entries[bucket_start[b+1]-1]
+    // (size is a power of two plus one)
+    std::vector<uint32_t> bucket_start;
+
+    //scratch space for build():
+    std::vector<uint32_t> point_bucket;
+};
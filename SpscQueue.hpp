@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * SpscQueue is a fixed-capacity, lock-free queue for exactly one producer
+ * thread and one consumer thread:
+ *
+ *  SpscQueue<Event> queue(1024); //capacity is rounded up to a power of two
+ *  //producer:
+ *  if (!queue.push(std::move(event))) { ... full -- keep it and try again later ... }
+ *  //consumer:
+ *  Event event;
+ *  while (queue.pop(&event)) { ... }
+ *
+ * Neither side ever blocks or allocates after construction. Each side only
+ * writes its own index (and reads the other's), so the two can run at full
+ * speed without taking turns on a lock.
+ */
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+template<typename T>
+struct SpscQueue {
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    //slots are shared between threads, so no copying:
+    SpscQueue(SpscQueue const &) = delete;
+    SpscQueue &operator=(SpscQueue const &) = delete;
+
+    //(producer) returns false (and leaves 'value' alone) if the queue is full:
+    bool push(T &&value) {
+        size_t tail = tail_index.load(std::memory_order_relaxed);
+        if (tail - head_cache > mask) {
+            head_cache = head_index.load(std::memory_order_acquire);
+            if (tail - head_cache > mask) return false;
+        }
+        slots[tail & mask] = std::move(value);
+        tail_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //(consumer) returns false if the queue is empty:
+    bool pop(T *value) {
+        size_t head = head_index.load(std::memory_order_relaxed);
+        if (head == tail_cache) {
+            tail_cache = tail_index.load(std::memory_order_acquire);
+            if (head == tail_cache) return false;
+        }
+        *value = std::move(slots[head & mask]);
+        head_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    //internals:
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    //(each index on its own cache line, along with the owning side's copy of the other index)
+    alignas(64) std::atomic<size_t> head_index{0}; //next slot to pop (written by consumer)
+    size_t tail_cache = 0; //(consumer's last look at tail_index)
+    alignas(64) std::atomic<size_t> tail_index{0}; //next slot to push (written by producer)
+    size_t head_cache = 0; //(producer's last look at head_index)
+};
@@ -0,0 +1,55 @@
+#include "TickScheduler.hpp"
+
+#include "Profiler.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+TickScheduler::TickScheduler(double tick_, uint32_t max_steps_) : tick(tick_), max_steps(std::max(1U, max_steps_)) {
+    next = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tick));
+}
+
+double TickScheduler::remain(Clock::time_point now) const {
+    return std::chrono::duration<double>(next - now).count();
+}
+
+uint32_t TickScheduler::start_tick(Clock::time_point now) {
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tick));
+
+    double late = std::max(0.0, -remain(now));
+    worst_lateness = std::max(worst_lateness, late);
+
+    //this tick, plus any whose start time has also passed:
+    auto due = uint64_t(std::floor(late / tick)) + 1;
+    auto run = uint32_t(std::min< uint64_t >(due, max_steps));
+
+    ticks += 1;
+    steps += run;
+    catch_up_steps += run - 1;
+    if (profiler && run > 1) profiler->count(Profiler::CatchUpSteps, run - 1);
+    if (due > run) {
+        //too far behind to catch up; forget the rest and start over from here:
+        dropped_ticks += due - run;
+        if (profiler) profiler->count(Profiler::DroppedTicks, due - run);
+        next = now + period;
+        
+        //(mention it, but not more than once a second)
+        unreported_drops += due - run;
+        if (now - last_report > std::chrono::seconds(1)) {
+            std::cout << "Server is falling behind: dropped " << unreported_drops << " ticks." << std::endl;
+            unreported_drops = 0;
+            last_report = now;
+        }
+    } else {
+        next += period * int64_t(run);
+    }
+    return run;
+}
+
+void TickScheduler::end_tick(Clock::time_point now) {
+    if (now > next) {
+        overruns += 1;
+        if (profiler) profiler->count(Profiler::Overruns);
+    }
+}
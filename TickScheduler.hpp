@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+ * TickScheduler decides when the server ticks, and what to do when it falls behind:
+ *
+ *  TickScheduler schedule(Game::Tick);
+ *  while (true) {
+ *      while (schedule.remain() > 0.0) poll(schedule.remain()); //handle network until the tick is due
+ *      uint32_t steps = schedule.start_tick(); //1 when on time, more when catching up
+ *      for (uint32_t s = 0; s < steps; ++s) game.update(Game::Tick);
+ *      send_states(); //(once, however many steps there were)
+ *      schedule.end_tick();
+ *  }
+ *
+ * A tick that runs past the next one's start time is an overrun. After one (or
+ * a stall elsewhere), the ticks that should have happened in the meantime are
+ * run as extra simulation steps before a single broadcast -- so the simulation
+ * keeps pace with the clock, but the server doesn't spend its time sending
+ * states nobody will see before the next one arrives, and network polling
+ * still gets its turn between ticks. At most MaxSteps steps are run at once;
+ * if the server is further behind than that, the extra ticks are dropped
+ * (the simulation runs slow) and the schedule restarts from now.
+ */
+
+#include <chrono>
+#include <cstdint>
+
+struct Profiler;
+
+struct TickScheduler {
+    typedef std::chrono::steady_clock Clock;
+
+    explicit TickScheduler(double tick_, uint32_t max_steps_ = MaxSteps);
+
+    //seconds until the next tick is due (zero or negative once it is):
+    double remain(Clock::time_point now = Clock::now()) const;
+
+    //start the tick that is due: returns how many simulation steps it should run
+    // (1, plus one for each tick that was missed, up to max_steps):
+    uint32_t start_tick(Clock::time_point now = Clock::now());
+
+    //done with the tick's work (counts an overrun if it ran past when the next tick was due):
+    void end_tick(Clock::time_point now = Clock::now());
+
+    //simulation steps to run in one tick, at most:
+    inline static constexpr uint32_t MaxSteps = 4;
+
+    double tick; //seconds per tick
+    uint32_t max_steps;
+    Clock::time_point next; //when the next tick is due
+
+    Profiler *profiler = nullptr; //(if set, counters are bumped there too)
+
+    //counters (since start):
+    uint64_t ticks = 0; //ticks started
+    uint64_t steps = 0; //simulation steps (ticks + catch_up_steps)
+    uint64_t catch_up_steps = 0; //extra steps run to catch up after falling behind
+    uint64_t dropped_ticks = 0; //ticks given up on (for being more than max_steps behind)
+    uint64_t overruns = 0; //ticks whose work went past the next tick's start
+    double worst_lateness = 0.0; //(seconds) latest a tick has started
+
+    //dropped ticks are mentioned on stdout at most once a second:
+    uint64_t unreported_drops = 0;
+    Clock::time_point last_report;
+};
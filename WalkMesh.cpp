@@ -1,14 +1,31 @@
 #include "WalkMesh.hpp"
 
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+#include "FileLock.hpp"
 
 #include <glm/gtx/norm.hpp>
+#include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/string_cast.hpp>
 
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <string>
+#include <stdexcept>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//SSE2 is part of x86-64 (and what MSVC builds for by default on 32-bit x86), so it needs no special build flags:
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WALKMESH_SSE2 1
+#endif
 
 /*
  * The following code was mostly written by myself, but checked against
@@ -17,22 +34,89 @@
  * as well as Nellie Tonev (ntonev)'s implementation
  */
 
+//what a WalkMesh built from vertices and triangles (rather than mapped from a baked file) has its views look at:
+struct Built {
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::uvec3> triangles;
+    std::vector<WalkMesh::TriangleFrame> frames;
+    std::vector<std::array<WalkMesh::Adjacent, 3>> adjacency;
+    std::vector<WalkMesh::EdgeTriangle> edge_triangles;
+    std::vector<WalkMesh::BvhNode> bvh;
+    std::vector<uint32_t> bvh_triangles;
+};
+
 WalkMesh::WalkMesh(std::vector<glm::vec3> const &vertices_, std::vector<glm::vec3> const &normals_,
-                   std::vector<glm::uvec3> const &triangles_)
-        : vertices(vertices_), normals(normals_), triangles(triangles_) {
-    
-    //construct next_vertex map (maps each edge to the next vertex in the triangle):
-    next_vertex.reserve(triangles.size() * 3);
-    auto do_next = [this](uint32_t a, uint32_t b, uint32_t c) {
-        auto ret = next_vertex.insert(std::make_pair(glm::uvec2(a, b), c));
-        assert(ret.second);
-    };
-    for (auto const &tri: triangles) {
-        do_next(tri.x, tri.y, tri.z);
-        do_next(tri.y, tri.z, tri.x);
-        do_next(tri.z, tri.x, tri.y);
+                   std::vector<glm::uvec3> const &triangles_) {
+    //everything is built into vectors that the views then look at:
+    auto built = std::make_shared<Built>();
+    storage = built;
+    
+    built->vertices = vertices_;
+    built->normals = normals_;
+    built->triangles = triangles_;
+    vertices = built->vertices;
+    normals = built->normals;
+    triangles = built->triangles;
+    
+    //construct sorted edge list (maps each edge to its triangle):
+    built->edge_triangles.reserve(triangles.size() * 3);
+    for (uint32_t t = 0; t < triangles.size(); ++t) {
+        glm::uvec3 const &tri = triangles[t];
+        for (uint32_t k = 0; k < 3; ++k) {
+            built->edge_triangles.emplace_back(EdgeTriangle{(uint64_t(tri[k]) << 32) | tri[(k + 1) % 3], t, 0});
+        }
+    }
+    std::sort(built->edge_triangles.begin(), built->edge_triangles.end(), [](EdgeTriangle const &a, EdgeTriangle const &b) {
+        return a.key < b.key;
+    });
+    edge_triangles = built->edge_triangles;
+    for (size_t i = 1; i < edge_triangles.size(); ++i) {
+        assert(edge_triangles[i - 1].key != edge_triangles[i].key && "each edge should only be in one triangle");
     }
     
+    //work out each triangle's frame:
+    built->frames.resize(triangles.size());
+    for (uint32_t t = 0; t < triangles.size(); ++t) {
+        glm::uvec3 const &tri = triangles[t];
+        TriangleFrame &frame = built->frames[t];
+        glm::vec3 const &a = vertices[tri.x];
+        glm::vec3 e1 = vertices[tri.y] - a;
+        glm::vec3 e2 = vertices[tri.z] - a;
+        frame.normal = glm::normalize(glm::cross(e1, e2));
+        
+        //(p - a = y * e1 + z * e2 + [something along the normal]; dotting both sides with e1 and e2 gives a 2x2 system
+        // for y and z, and to_y / to_z are the rows of its inverse applied to e1, e2)
+        float d11 = glm::dot(e1, e1);
+        float d12 = glm::dot(e1, e2);
+        float d22 = glm::dot(e2, e2);
+        float inv_det = 1.0f / (d11 * d22 - d12 * d12);
+        frame.to_y = (d22 * e1 - d12 * e2) * inv_det;
+        frame.to_z = (d11 * e2 - d12 * e1) * inv_det;
+        
+        for (uint32_t k = 0; k < 3; ++k) {
+            glm::vec3 along = glm::normalize(vertices[tri[(k + 1) % 3]] - vertices[tri[k]]);
+            frame.edge_in[k] = glm::cross(frame.normal, along);
+        }
+    }
+    frames = built->frames;
+    
+    //construct adjacency (what's over each edge is the triangle with the reversed edge):
+    built->adjacency.resize(triangles.size());
+    for (uint32_t t = 0; t < triangles.size(); ++t) {
+        glm::uvec3 const &tri = triangles[t];
+        for (uint32_t k = 0; k < 3; ++k) {
+            uint32_t other = find_edge_triangle(tri[(k + 1) % 3], tri[k]);
+            if (other == -1U) continue;
+            glm::uvec3 const &o = triangles[other];
+            Adjacent &over = built->adjacency[t][k];
+            over.triangle = other;
+            over.vertex = o.x + o.y + o.z - tri[k] - tri[(k + 1) % 3];
+            over.rotation = glm::rotation(frames[t].normal, frames[other].normal);
+        }
+    }
+    adjacency = built->adjacency;
+    
     //DEBUG: are vertex normals consistent with geometric normals?
     for (auto const &tri: triangles) {
         glm::vec3 const &a = vertices[tri.x];
@@ -46,22 +130,148 @@ WalkMesh::WalkMesh(std::vector<glm::vec3> const &vertices_, std::vector<glm::vec
         
         assert(da > 0.1f && db > 0.1f && dc > 0.1f);
     }
+    
+    //build bvh by splitting triangles at the median centroid along the longest axis, until leaves are small:
+    const uint32_t LeafSize = 4;
+    std::vector<BvhNode> &nodes = built->bvh;
+    std::vector<uint32_t> &leaf_triangles = built->bvh_triangles;
+    std::vector<glm::vec3> centroids;
+    centroids.reserve(triangles.size());
+    leaf_triangles.resize(triangles.size());
+    for (uint32_t t = 0; t < triangles.size(); ++t) {
+        glm::uvec3 const &tri = triangles[t];
+        centroids.emplace_back((vertices[tri.x] + vertices[tri.y] + vertices[tri.z]) / 3.0f);
+        leaf_triangles[t] = t;
+    }
+    nodes.reserve(2 * (triangles.size() / LeafSize + 1));
+    nodes.emplace_back(BvhNode{glm::vec3(0.0f), glm::vec3(0.0f), 0, uint32_t(triangles.size())});
+    std::vector<uint32_t> to_split{0};
+    while (!to_split.empty()) {
+        uint32_t n = to_split.back();
+        to_split.pop_back();
+        uint32_t first = nodes[n].first;
+        uint32_t count = nodes[n].count;
+        
+        glm::vec3 min(std::numeric_limits<float>::infinity());
+        glm::vec3 max(-std::numeric_limits<float>::infinity());
+        glm::vec3 centroid_min = min;
+        glm::vec3 centroid_max = max;
+        for (uint32_t i = first; i < first + count; ++i) {
+            glm::uvec3 const &tri = triangles[leaf_triangles[i]];
+            for (uint32_t v: {tri.x, tri.y, tri.z}) {
+                min = glm::min(min, vertices[v]);
+                max = glm::max(max, vertices[v]);
+            }
+            centroid_min = glm::min(centroid_min, centroids[leaf_triangles[i]]);
+            centroid_max = glm::max(centroid_max, centroids[leaf_triangles[i]]);
+        }
+        nodes[n].min = min;
+        nodes[n].max = max;
+        if (count <= LeafSize) continue;
+        
+        glm::vec3 extent = centroid_max - centroid_min;
+        int axis = (extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2));
+        auto begin = leaf_triangles.begin() + first;
+        auto mid = begin + count / 2;
+        std::nth_element(begin, mid, begin + count, [&](uint32_t a, uint32_t b) {
+            return centroids[a][axis] < centroids[b][axis];
+        });
+        
+        auto child = uint32_t(nodes.size());
+        nodes.emplace_back(BvhNode{glm::vec3(0.0f), glm::vec3(0.0f), first, count / 2});
+        nodes.emplace_back(BvhNode{glm::vec3(0.0f), glm::vec3(0.0f), first + count / 2, count - count / 2});
+        nodes[n].first = child;
+        nodes[n].count = 0;
+        to_split.emplace_back(child);
+        to_split.emplace_back(child + 1);
+    }
+    bvh = nodes;
+    bvh_triangles = leaf_triangles;
 }
 
-//project pt to the plane of triangle a,b,c and return the barycentric weights of the projected point:
-glm::vec3 barycentric_weights(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, glm::vec3 const &pt) {
-    glm::vec3 abh = glm::cross(glm::cross(c - a, b - a), b - a);
-    glm::vec3 bch = glm::cross(glm::cross(a - b, c - b), c - b);
-    glm::vec3 cah = glm::cross(glm::cross(b - c, a - c), a - c);
-    float hab = glm::dot(pt - a, abh) / glm::length(abh);
-    float hbc = glm::dot(pt - b, bch) / glm::length(bch);
-    float hca = glm::dot(pt - c, cah) / glm::length(cah);
-    glm::vec3 w = glm::vec3(
-            glm::length(c - b) * hbc,
-            glm::length(a - c) * hca,
-            glm::length(b - a) * hab
-    );
-    return w / (w[0] + w[1] + w[2]);
+uint32_t WalkMesh::find_edge_triangle(uint32_t a, uint32_t b) const {
+    uint64_t key = (uint64_t(a) << 32) | b;
+    auto f = std::lower_bound(edge_triangles.begin(), edge_triangles.end(), key, [](EdgeTriangle const &e, uint64_t k) {
+        return e.key < k;
+    });
+    if (f == edge_triangles.end() || f->key != key) return -1U;
+    return f->triangle;
+}
+
+uint32_t WalkMesh::find_triangle(WalkPoint const &wp) const {
+    if (wp.triangle != -1U) return wp.triangle;
+    //edge x->y belongs to the triangle if the indices are in CCW order, edge y->x if not:
+    for (uint32_t t: {find_edge_triangle(wp.indices.x, wp.indices.y), find_edge_triangle(wp.indices.y, wp.indices.x)}) {
+        if (t == -1U) continue;
+        glm::uvec3 const &tri = triangles[t];
+        if (tri.x == wp.indices.z || tri.y == wp.indices.z || tri.z == wp.indices.z) return t;
+    }
+    return -1U;
+}
+
+//if the closest point on triangle 'tri' to world_point is closer than *closest_dis2, update *closest and *closest_dis2:
+static void check_triangle(ArrayView<glm::vec3> const &vertices, glm::uvec3 const &tri, uint32_t t,
+                           WalkMesh::TriangleFrame const &frame,
+                           glm::vec3 const &world_point, WalkPoint *closest_, float *closest_dis2_) {
+    auto &closest = *closest_;
+    auto &closest_dis2 = *closest_dis2_;
+    
+    //find closest point on triangle:
+    
+    glm::vec3 const &a = vertices[tri.x];
+    glm::vec3 const &b = vertices[tri.y];
+    glm::vec3 const &c = vertices[tri.z];
+    
+    //get barycentric coordinates of closest point in the plane of (a,b,c):
+    float y = glm::dot(frame.to_y, world_point - a);
+    float z = glm::dot(frame.to_z, world_point - a);
+    glm::vec3 coords = glm::vec3(1.0f - y - z, y, z);
+    
+    //is that point inside the triangle?
+    if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
+        //yes, point is inside triangle.
+        float dis2 = glm::length2(world_point - (coords.x * a + coords.y * b + coords.z * c));
+        if (dis2 < closest_dis2) {
+            closest_dis2 = dis2;
+            closest.indices = tri;
+            closest.weights = coords;
+            closest.triangle = t;
+        }
+    } else {
+        //check triangle vertices and edges:
+        auto check_edge = [&world_point, &closest, &closest_dis2, &vertices, t](uint32_t ai, uint32_t bi, uint32_t ci) {
+            glm::vec3 const &a = vertices[ai];
+            glm::vec3 const &b = vertices[bi];
+            
+            //find closest point on line segment ab:
+            float along = glm::dot(world_point - a, b - a);
+            float max = glm::dot(b - a, b - a);
+            glm::vec3 pt;
+            glm::vec3 coords;
+            if (along < 0.0f) {
+                pt = a;
+                coords = glm::vec3(1.0f, 0.0f, 0.0f);
+            } else if (along > max) {
+                pt = b;
+                coords = glm::vec3(0.0f, 1.0f, 0.0f);
+            } else {
+                float amt = along / max;
+                pt = glm::mix(a, b, amt);
+                coords = glm::vec3(1.0f - amt, amt, 0.0f);
+            }
+            
+            float dis2 = glm::length2(world_point - pt);
+            if (dis2 < closest_dis2) {
+                closest_dis2 = dis2;
+                closest.indices = glm::uvec3(ai, bi, ci);
+                closest.weights = coords;
+                closest.triangle = t;
+            }
+        };
+        check_edge(tri.x, tri.y, tri.z);
+        check_edge(tri.y, tri.z, tri.x);
+        check_edge(tri.z, tri.x, tri.y);
+    }
 }
 
 WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
@@ -70,58 +280,36 @@ WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
     WalkPoint closest;
     float closest_dis2 = std::numeric_limits<float>::infinity();
     
-    for (auto const &tri: triangles) {
-        //find closest point on triangle:
-        
-        glm::vec3 const &a = vertices[tri.x];
-        glm::vec3 const &b = vertices[tri.y];
-        glm::vec3 const &c = vertices[tri.z];
-        
-        //get barycentric coordinates of closest point in the plane of (a,b,c):
-        glm::vec3 coords = barycentric_weights(a, b, c, world_point);
-        
-        //is that point inside the triangle?
-        if (coords.x >= 0.0f && coords.y >= 0.0f && coords.z >= 0.0f) {
-            //yes, point is inside triangle.
-            float dis2 = glm::length2(world_point - to_world_point(WalkPoint(tri, coords)));
-            if (dis2 < closest_dis2) {
-                closest_dis2 = dis2;
-                closest.indices = tri;
-                closest.weights = coords;
+    //squared distance from world_point to a node's bounds (no triangle under the node can be any closer):
+    auto node_dis2 = [&world_point](BvhNode const &node) {
+        glm::vec3 outside = glm::max(glm::vec3(0.0f), glm::max(node.min - world_point, world_point - node.max));
+        return glm::dot(outside, outside);
+    };
+    
+    //visit nodes nearest-first, skipping any that can't hold anything closer than what's been found so far:
+    // (the tree is balanced, so its depth is about log2(triangles / LeafSize) -- BvhMaxDepth levels is plenty)
+    std::pair<uint32_t, float> stack[BvhMaxDepth + 1];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = std::make_pair(0U, node_dis2(bvh[0]));
+    while (stack_size > 0) {
+        auto [n, dis2] = stack[--stack_size];
+        if (dis2 >= closest_dis2) continue;
+        BvhNode const &node = bvh[n];
+        if (node.count != 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                check_triangle(vertices, triangles[bvh_triangles[i]], bvh_triangles[i], frames[bvh_triangles[i]], world_point, &closest, &closest_dis2);
             }
         } else {
-            //check triangle vertices and edges:
-            auto check_edge = [&world_point, &closest, &closest_dis2, this](uint32_t ai, uint32_t bi, uint32_t ci) {
-                glm::vec3 const &a = vertices[ai];
-                glm::vec3 const &b = vertices[bi];
-                
-                //find closest point on line segment ab:
-                float along = glm::dot(world_point - a, b - a);
-                float max = glm::dot(b - a, b - a);
-                glm::vec3 pt;
-                glm::vec3 coords;
-                if (along < 0.0f) {
-                    pt = a;
-                    coords = glm::vec3(1.0f, 0.0f, 0.0f);
-                } else if (along > max) {
-                    pt = b;
-                    coords = glm::vec3(0.0f, 1.0f, 0.0f);
-                } else {
-                    float amt = along / max;
-                    pt = glm::mix(a, b, amt);
-                    coords = glm::vec3(1.0f - amt, amt, 0.0f);
-                }
-                
-                float dis2 = glm::length2(world_point - pt);
-                if (dis2 < closest_dis2) {
-                    closest_dis2 = dis2;
-                    closest.indices = glm::uvec3(ai, bi, ci);
-                    closest.weights = coords;
-                }
-            };
-            check_edge(tri.x, tri.y, tri.z);
-            check_edge(tri.y, tri.z, tri.x);
-            check_edge(tri.z, tri.x, tri.y);
+            float dis2_a = node_dis2(bvh[node.first]);
+            float dis2_b = node_dis2(bvh[node.first + 1]);
+            //(push the farther child first, so the nearer one gets looked at first)
+            if (dis2_a < dis2_b) {
+                stack[stack_size++] = std::make_pair(node.first + 1, dis2_b);
+                stack[stack_size++] = std::make_pair(node.first, dis2_a);
+            } else {
+                stack[stack_size++] = std::make_pair(node.first, dis2_a);
+                stack[stack_size++] = std::make_pair(node.first + 1, dis2_b);
+            }
         }
     }
     assert(closest.indices.x < vertices.size());
@@ -130,6 +318,21 @@ WalkPoint WalkMesh::nearest_walk_point(glm::vec3 const &world_point) const {
     return closest;
 }
 
+WalkPoint WalkMesh::nearest_walk_point_linear(glm::vec3 const &world_point) const {
+    assert(!triangles.empty() && "Cannot start on an empty walkmesh");
+    
+    WalkPoint closest;
+    float closest_dis2 = std::numeric_limits<float>::infinity();
+    
+    for (uint32_t t = 0; t < triangles.size(); ++t) {
+        check_triangle(vertices, triangles[t], t, frames[t], world_point, &closest, &closest_dis2);
+    }
+    assert(closest.indices.x < vertices.size());
+    assert(closest.indices.y < vertices.size());
+    assert(closest.indices.z < vertices.size());
+    return closest;
+}
+
 
 void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, WalkPoint *end_, float *time_) const {
     assert(end_);
@@ -138,10 +341,22 @@ void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, W
     assert(time_);
     auto &time = *time_;
     
-    auto &a = vertices[start.indices.x];
-    auto &b = vertices[start.indices.y];
-    auto &c = vertices[start.indices.z];
-    glm::vec3 bary_step = barycentric_weights(a, b, c, to_world_point(start) + step) - start.weights;
+    //weights are linear in position, so the change in weights over the step only depends on the step:
+    uint32_t t = find_triangle(start);
+    assert(t != -1U && "WalkPoint should be on a triangle of this mesh");
+    glm::uvec3 const &tri = triangles[t];
+    TriangleFrame const &frame = frames[t];
+    float step_y = glm::dot(frame.to_y, step);
+    float step_z = glm::dot(frame.to_z, step);
+    glm::vec3 tri_step = glm::vec3(-step_y - step_z, step_y, step_z); //(in triangle order)
+    auto corner = [&tri](uint32_t v) {
+        return (tri.x == v ? 0 : (tri.y == v ? 1 : 2));
+    };
+    glm::vec3 bary_step = glm::vec3(
+            tri_step[corner(start.indices.x)],
+            tri_step[corner(start.indices.y)],
+            tri_step[corner(start.indices.z)]
+    );
     
     // if no edge is crossed, event will just be taking the whole step:
     time = 1.0f;
@@ -157,7 +372,7 @@ void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, W
             crossed_edge = i;
         }
     }
-    end = WalkPoint(start.indices, start.weights + time * bary_step);
+    end = WalkPoint(start.indices, start.weights + time * bary_step, t);
     
     // Remember: our convention is that when a WalkPoint is on an edge,
     // then at.weights.z == 0.0f (so will likely need to re-order the indices)
@@ -165,13 +380,15 @@ void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, W
         case 0:
             end = WalkPoint(
                     glm::uvec3(end.indices.y, end.indices.z, end.indices.x),
-                    glm::vec3(end.weights.y, end.weights.z, 0.0f)
+                    glm::vec3(end.weights.y, end.weights.z, 0.0f),
+                    end.triangle
             );
             break;
         case 1:
             end = WalkPoint(
                     glm::uvec3(end.indices.z, end.indices.x, end.indices.y),
-                    glm::vec3(end.weights.z, end.weights.x, 0.0f)
+                    glm::vec3(end.weights.z, end.weights.x, 0.0f),
+                    end.triangle
             );
             break;
         case 2:
@@ -183,6 +400,53 @@ void WalkMesh::walk_in_triangle(WalkPoint const &start, glm::vec3 const &step, W
     }
 }
 
+//the orders a WalkPoint might list a triangle's vertices in: indices[k] == tri[Orders[order][k]]
+// (walking only ever produces the first three -- rotations of the CCW order -- but the others are cheap to allow)
+static const glm::uvec3 Orders[6] = {
+        glm::uvec3(0, 1, 2), glm::uvec3(1, 2, 0), glm::uvec3(2, 0, 1),
+        glm::uvec3(0, 2, 1), glm::uvec3(2, 1, 0), glm::uvec3(1, 0, 2),
+};
+
+PackedWalkPoint WalkMesh::pack(WalkPoint const &wp) const {
+    uint32_t t = find_triangle(wp);
+    assert(t != -1U && "WalkPoint should be on a triangle of this mesh");
+    assert(t < (1U << 29));
+    
+    glm::uvec3 const &tri = triangles[t];
+    uint32_t order = 0;
+    while (order < 6 && glm::uvec3(tri[Orders[order].x], tri[Orders[order].y], tri[Orders[order].z]) != wp.indices) {
+        ++order;
+    }
+    assert(order < 6);
+    
+    auto quantize = [](float w) {
+        return uint16_t(std::round(std::min(std::max(w, 0.0f), 1.0f) * 65535.0f));
+    };
+    
+    PackedWalkPoint pwp;
+    pwp.triangle = t | (order << 29);
+    pwp.weight_x = quantize(wp.weights.x);
+    pwp.weight_z = quantize(wp.weights.z);
+    return pwp;
+}
+
+WalkPoint WalkMesh::unpack(PackedWalkPoint const &pwp) const {
+    uint32_t t = pwp.triangle & ((1U << 29) - 1);
+    uint32_t order = pwp.triangle >> 29;
+    if (t >= triangles.size() || order >= 6) {
+        throw std::runtime_error("Packed walk point refers to triangle " + std::to_string(t) + " (order " + std::to_string(order) + "), which isn't in the walk mesh.");
+    }
+    
+    glm::uvec3 const &tri = triangles[t];
+    float x = pwp.weight_x / 65535.0f;
+    float z = pwp.weight_z / 65535.0f;
+    return WalkPoint(
+            glm::uvec3(tri[Orders[order].x], tri[Orders[order].y], tri[Orders[order].z]),
+            glm::vec3(x, std::max(0.0f, 1.0f - x - z), z),
+            t
+    );
+}
+
 bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *rotation_) const {
     assert(end_);
     auto &end = *end_;
@@ -192,34 +456,33 @@ bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *ro
     
     assert(start.weights.z == 0.0f); //*must* be on an edge.
     
+    //find which of the triangle's edges 'edge' is:
+    uint32_t t = find_triangle(start);
+    assert(t != -1U && "WalkPoint should be on a triangle of this mesh");
+    glm::uvec3 const &tri = triangles[t];
+    uint32_t k = (tri.x == start.indices.x ? 0 : (tri.y == start.indices.x ? 1 : 2));
+    assert(tri[k] == start.indices.x && tri[(k + 1) % 3] == start.indices.y && "WalkPoint should list its triangle's vertices in CCW order");
+    
     //check if 'edge' is a non-boundary edge:
-    auto pair = next_vertex.find(glm::uvec2(start.indices.y, start.indices.x));
-    if (pair != next_vertex.end()) {
+    Adjacent const &over = adjacency[t][k];
+    if (over.triangle != -1U) {
         //make 'end' represent the same (world) point, but on triangle (edge.y, edge.x, [other point]):
         end = WalkPoint(
                 glm::uvec3(
                         start.indices.y,
                         start.indices.x,
-                        pair->second
+                        over.vertex
                 ),
                 glm::vec3(
                         start.weights.y,
                         start.weights.x,
                         0.0f
-                )
+                ),
+                over.triangle
         );
         
-        //make 'rotation' the rotation that takes (start.indices)'s normal to (end.indices)'s normal:
-        glm::vec3 start_norm = glm::normalize(glm::cross(
-                vertices[start.indices.x] - vertices[start.indices.z],
-                vertices[start.indices.y] - vertices[start.indices.z]
-        ));
-        glm::vec3 end_norm = glm::normalize(glm::cross(
-                vertices[end.indices.x] - vertices[end.indices.z],
-                vertices[end.indices.y] - vertices[end.indices.z]
-        ));
-        
-        rotation = glm::rotation(start_norm, end_norm);
+        //'rotation' takes this triangle's normal to the other one's:
+        rotation = over.rotation;
         
         return true;
     } else {
@@ -229,10 +492,408 @@ bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *ro
     }
 }
 
+void WalkMesh::walk(WalkPoint *at_, glm::vec3 remain) const {
+    assert(at_);
+    auto &at = *at_;
+    
+    for (size_t i = 0; i < 10; i++) {
+        if (remain == glm::vec3(0.0f, 0.0f, 0.0f)) {
+            break;
+        }
+        WalkPoint end;
+        float time;
+        
+        walk_in_triangle(at, remain, &end, &time);
+        at = end;
+        if (time == 1.0f) {
+            remain = glm::vec3(0.0f, 0.0f, 0.0f);
+            break;
+        }
+        remain *= (1.0f - time);
+        glm::quat rotation;
+        if (cross_edge(at, &end, &rotation)) {
+            at = end;
+            remain = rotation * remain;
+        } else {
+            glm::vec3 const &in = edge_in(at);
+            
+            // check how much 'remain' is pointing out of the triangle:
+            float d = glm::dot(remain, in);
+            if (d < 0.0f) {
+                // bounce off of the wall:
+                remain += (-1.25f * d) * in;
+            } else {
+                // if it's just pointing along the edge, bend slightly away from wall:
+                remain += 0.01f * d * in;
+            }
+        }
+    }
+    
+    if (remain != glm::vec3(0.0f)) {
+        std::cout << "NOTE: code used full iteration budget for walking." << std::endl;
+    }
+}
+
+void WalkMesh::walk_many(WalkPoint *at, glm::vec3 const *steps, size_t count) const {
+    size_t i = 0;
+    
+#ifdef WALKMESH_SSE2
+    //four walkers at a time, one per lane: this is walk_in_triangle's math (in triangle order rather than each
+    // walker's own vertex order), which gives exactly the same weights as walk() would for walkers that don't reach
+    // an edge; the others are handed to walk() from where they started:
+    for (; i + 4 <= count; i += 4) {
+        alignas(16) float to_y[3][4], to_z[3][4], step[3][4], weights[3][4];
+        uint32_t tris[4];
+        glm::uvec3 corners[4]; //where each walker's indices are in its triangle
+        for (uint32_t l = 0; l < 4; ++l) {
+            WalkPoint const &wp = at[i + l];
+            uint32_t t = find_triangle(wp);
+            assert(t != -1U && "WalkPoint should be on a triangle of this mesh");
+            glm::uvec3 const &tri = triangles[t];
+            TriangleFrame const &frame = frames[t];
+            tris[l] = t;
+            for (uint32_t k = 0; k < 3; ++k) {
+                corners[l][k] = (tri.x == wp.indices[k] ? 0 : (tri.y == wp.indices[k] ? 1 : 2));
+                weights[corners[l][k]][l] = wp.weights[k];
+                to_y[k][l] = frame.to_y[k];
+                to_z[k][l] = frame.to_z[k];
+                step[k][l] = steps[i + l][k];
+            }
+        }
+        
+        //change in weights over the step (same operations, in the same order, as walk_in_triangle):
+        __m128 sign = _mm_set1_ps(-0.0f);
+        __m128 step_x = _mm_load_ps(step[0]);
+        __m128 step_y = _mm_load_ps(step[1]);
+        __m128 step_z = _mm_load_ps(step[2]);
+        __m128 delta[3];
+        delta[1] = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_load_ps(to_y[0]), step_x),
+                _mm_mul_ps(_mm_load_ps(to_y[1]), step_y)),
+                _mm_mul_ps(_mm_load_ps(to_y[2]), step_z));
+        delta[2] = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_load_ps(to_z[0]), step_x),
+                _mm_mul_ps(_mm_load_ps(to_z[1]), step_y)),
+                _mm_mul_ps(_mm_load_ps(to_z[2]), step_z));
+        delta[0] = _mm_sub_ps(_mm_xor_ps(delta[1], sign), delta[2]);
+        
+        //a walker reaches an edge if some weight is decreasing and gets to zero before the end of the step:
+        __m128 reaches_edge = _mm_setzero_ps();
+        for (uint32_t k = 0; k < 3; ++k) {
+            __m128 w = _mm_load_ps(weights[k]);
+            __m128 time = _mm_div_ps(_mm_xor_ps(w, sign), delta[k]);
+            reaches_edge = _mm_or_ps(reaches_edge, _mm_and_ps(
+                    _mm_cmplt_ps(delta[k], _mm_setzero_ps()),
+                    _mm_cmplt_ps(time, _mm_set1_ps(1.0f))));
+            _mm_store_ps(weights[k], _mm_add_ps(w, delta[k]));
+        }
+        int peel = _mm_movemask_ps(reaches_edge);
+        
+        for (uint32_t l = 0; l < 4; ++l) {
+            if (peel & (1 << l)) {
+                walk(&at[i + l], steps[i + l]);
+            } else if (steps[i + l] != glm::vec3(0.0f)) {
+                WalkPoint &wp = at[i + l];
+                wp.weights = glm::vec3(weights[corners[l].x][l], weights[corners[l].y][l], weights[corners[l].z][l]);
+                wp.triangle = tris[l];
+            }
+        }
+    }
+#endif
+    
+    for (; i < count; ++i) {
+        walk(&at[i], steps[i]);
+    }
+}
+
+glm::vec3 const &WalkMesh::edge_in(WalkPoint const &wp) const {
+    uint32_t t = find_triangle(wp);
+    assert(t != -1U && "WalkPoint should be on a triangle of this mesh");
+    //(the edge between indices.x and indices.y is the one opposite indices.z, whichever way around it's listed)
+    glm::uvec3 const &tri = triangles[t];
+    uint32_t k = (tri.z == wp.indices.z ? 0 : (tri.x == wp.indices.z ? 1 : 2));
+    return frames[t].edge_in[k];
+}
+
+//Baked files are a header, a BakedMesh per mesh, and then the arrays those point at (each starting on a 16-byte boundary),
+// in exactly the layout WalkMesh uses, so a mapped baked file can be used without reading or copying anything:
+struct BakedArray {
+    uint64_t offset = 0; //(from the start of the file)
+    uint64_t count = 0;
+};
+
+struct BakedMesh {
+    BakedArray name; //(chars)
+    BakedArray vertices, normals, triangles;
+    BakedArray frames, adjacency, edge_triangles, bvh, bvh_triangles;
+};
+
+//a baked file is only usable by a build that lays out everything the same way, so the header records how this one does:
+static const std::array<uint32_t, 8> BakedLayout{
+        0x01020304, //(byte order)
+        uint32_t(sizeof(glm::vec3)),
+        uint32_t(sizeof(glm::uvec3)),
+        uint32_t(sizeof(WalkMesh::TriangleFrame)),
+        uint32_t(sizeof(std::array<WalkMesh::Adjacent, 3>)),
+        uint32_t(sizeof(WalkMesh::EdgeTriangle)),
+        uint32_t(sizeof(WalkMesh::BvhNode)),
+        uint32_t(sizeof(BakedMesh)),
+};
+
+struct BakedHeader {
+    char magic[4] = {'w', 'b', 'k', '0'};
+    uint32_t mesh_count = 0;
+    std::array<uint32_t, 8> layout = BakedLayout;
+    WalkMeshes::Stamp source_stamp;
+};
+static_assert(sizeof(BakedHeader) == 56, "BakedHeader has no padding.");
+
+//view of a baked array in a mapped file (throws if it isn't all in the file):
+template<typename T>
+static ArrayView<T> baked_view(MappedFile const &file, BakedArray const &array, std::string const &filename) {
+    if (array.offset % 16 != 0 || array.offset > file.size
+        || array.count > (file.size - array.offset) / sizeof(T)) {
+        throw std::runtime_error("Invalid array in baked walkmesh file '" + filename + "'");
+    }
+    return ArrayView<T>(reinterpret_cast<T const *>(file.data + array.offset), size_t(array.count));
+}
+
+void WalkMeshes::load_baked(std::string const &filename) {
+    auto file = std::make_shared<MappedFile>(filename);
+    
+    BakedHeader header;
+    if (file->size < sizeof(header)) {
+        throw std::runtime_error("Baked walkmesh file '" + filename + "' is too short");
+    }
+    std::memcpy(&header, file->data, sizeof(header));
+    if (std::string(header.magic, 4) != "wbk0") {
+        throw std::runtime_error("Unexpected magic number in baked walkmesh file '" + filename + "'");
+    }
+    if (header.layout != BakedLayout) {
+        throw std::runtime_error("Baked walkmesh file '" + filename + "' was written by a build with a different layout");
+    }
+    source_stamp = header.source_stamp;
+    
+    BakedArray mesh_table;
+    mesh_table.offset = sizeof(header);
+    mesh_table.count = header.mesh_count;
+    //(BakedHeader is 56 bytes, so the table isn't 16-aligned; it's only ever copied out of, so that's fine)
+    if (mesh_table.count > (file->size - mesh_table.offset) / sizeof(BakedMesh)) {
+        throw std::runtime_error("Invalid mesh table in baked walkmesh file '" + filename + "'");
+    }
+    
+    for (uint32_t m = 0; m < header.mesh_count; ++m) {
+        BakedMesh baked;
+        std::memcpy(&baked, file->data + mesh_table.offset + m * sizeof(BakedMesh), sizeof(BakedMesh));
+        
+        ArrayView<char> name = baked_view<char>(*file, baked.name, filename);
+        
+        WalkMesh wm;
+        wm.storage = file;
+        wm.vertices = baked_view<glm::vec3>(*file, baked.vertices, filename);
+        wm.normals = baked_view<glm::vec3>(*file, baked.normals, filename);
+        wm.triangles = baked_view<glm::uvec3>(*file, baked.triangles, filename);
+        wm.frames = baked_view<WalkMesh::TriangleFrame>(*file, baked.frames, filename);
+        wm.adjacency = baked_view<std::array<WalkMesh::Adjacent, 3>>(*file, baked.adjacency, filename);
+        wm.edge_triangles = baked_view<WalkMesh::EdgeTriangle>(*file, baked.edge_triangles, filename);
+        wm.bvh = baked_view<WalkMesh::BvhNode>(*file, baked.bvh, filename);
+        wm.bvh_triangles = baked_view<uint32_t>(*file, baked.bvh_triangles, filename);
+        
+        //(the rest was derived from the triangles by this same build, but a damaged file could still send
+        // lookups anywhere, so every index is checked too)
+        if (wm.normals.size() != wm.vertices.size()
+            || wm.frames.size() != wm.triangles.size()
+            || wm.adjacency.size() != wm.triangles.size()
+            || wm.edge_triangles.size() != 3 * wm.triangles.size()
+            || wm.bvh_triangles.size() != wm.triangles.size()
+            || wm.bvh.empty()) {
+            throw std::runtime_error("Mis-matched array sizes in baked walkmesh file '" + filename + "'");
+        }
+        for (auto const &tri: wm.triangles) {
+            if (!(tri.x < wm.vertices.size() && tri.y < wm.vertices.size() && tri.z < wm.vertices.size())) {
+                throw std::runtime_error("Invalid triangle in baked walkmesh file '" + filename + "'");
+            }
+        }
+        for (auto const &adjacent: wm.adjacency) {
+            for (auto const &over: adjacent) {
+                if (over.triangle != -1U && !(over.triangle < wm.triangles.size() && over.vertex < wm.vertices.size())) {
+                    throw std::runtime_error("Invalid adjacency in baked walkmesh file '" + filename + "'");
+                }
+            }
+        }
+        for (auto const &edge: wm.edge_triangles) {
+            if (!(edge.triangle < wm.triangles.size())) {
+                throw std::runtime_error("Invalid edge in baked walkmesh file '" + filename + "'");
+            }
+        }
+        //(children always come after their parent, so there are no cycles, and depths can be worked out in order)
+        std::vector<uint32_t> depth(wm.bvh.size(), 0);
+        for (uint32_t n = 0; n < wm.bvh.size(); ++n) {
+            WalkMesh::BvhNode const &node = wm.bvh[n];
+            if (node.count != 0) {
+                if (!(node.first <= wm.bvh_triangles.size() && node.count <= wm.bvh_triangles.size() - node.first)) {
+                    throw std::runtime_error("Invalid bvh leaf in baked walkmesh file '" + filename + "'");
+                }
+            } else {
+                if (!(node.first > n && node.first < wm.bvh.size() - 1 && depth[n] < WalkMesh::BvhMaxDepth)) {
+                    throw std::runtime_error("Invalid bvh node in baked walkmesh file '" + filename + "'");
+                }
+                depth[node.first] = std::max(depth[node.first], depth[n] + 1);
+                depth[node.first + 1] = std::max(depth[node.first + 1], depth[n] + 1);
+            }
+        }
+        for (uint32_t t: wm.bvh_triangles) {
+            if (!(t < wm.triangles.size())) {
+                throw std::runtime_error("Invalid bvh triangle in baked walkmesh file '" + filename + "'");
+            }
+        }
+        
+        auto ret = meshes.emplace(std::string(name.begin(), name.end()), std::move(wm));
+        if (!ret.second) {
+            throw std::runtime_error("WalkMesh with duplicated name '" + ret.first->first + "' in '" + filename + "'");
+        }
+    }
+}
+
+void WalkMeshes::write_baked(std::string const &filename, Stamp const &source_stamp_) const {
+    //(meshes go in name order, so the same meshes always bake to the same bytes)
+    std::vector<std::pair<std::string const *, WalkMesh const *>> sorted;
+    for (auto const &[name, wm]: meshes) {
+        sorted.emplace_back(&name, &wm);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](auto const &a, auto const &b) { return *a.first < *b.first; });
+    
+    //lay out the arrays after the header and mesh table:
+    std::vector<std::pair<void const *, size_t>> blobs; //(what to write at each offset)
+    std::vector<uint64_t> offsets;
+    uint64_t end = sizeof(BakedHeader) + sorted.size() * sizeof(BakedMesh);
+    auto place = [&](void const *data, size_t count, size_t element_size) {
+        BakedArray array;
+        array.offset = (end + 15) / 16 * 16;
+        array.count = count;
+        end = array.offset + count * element_size;
+        blobs.emplace_back(data, count * element_size);
+        offsets.emplace_back(array.offset);
+        return array;
+    };
+    std::vector<BakedMesh> table;
+    for (auto const &[name, wm]: sorted) {
+        BakedMesh baked;
+        baked.name = place(name->data(), name->size(), sizeof(char));
+        baked.vertices = place(wm->vertices.data(), wm->vertices.size(), sizeof(glm::vec3));
+        baked.normals = place(wm->normals.data(), wm->normals.size(), sizeof(glm::vec3));
+        baked.triangles = place(wm->triangles.data(), wm->triangles.size(), sizeof(glm::uvec3));
+        baked.frames = place(wm->frames.data(), wm->frames.size(), sizeof(WalkMesh::TriangleFrame));
+        baked.adjacency = place(wm->adjacency.data(), wm->adjacency.size(), sizeof(std::array<WalkMesh::Adjacent, 3>));
+        baked.edge_triangles = place(wm->edge_triangles.data(), wm->edge_triangles.size(), sizeof(WalkMesh::EdgeTriangle));
+        baked.bvh = place(wm->bvh.data(), wm->bvh.size(), sizeof(WalkMesh::BvhNode));
+        baked.bvh_triangles = place(wm->bvh_triangles.data(), wm->bvh_triangles.size(), sizeof(uint32_t));
+        table.emplace_back(baked);
+    }
+    
+    BakedHeader header;
+    header.mesh_count = uint32_t(table.size());
+    header.source_stamp = source_stamp_;
+    
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(table.data()), table.size() * sizeof(BakedMesh));
+    static const char zeros[16] = {};
+    uint64_t at = sizeof(BakedHeader) + table.size() * sizeof(BakedMesh);
+    for (size_t i = 0; i < blobs.size(); ++i) {
+        file.write(zeros, std::streamsize(offsets[i] - at));
+        file.write(reinterpret_cast<char const *>(blobs[i].first), std::streamsize(blobs[i].second));
+        at = offsets[i] + blobs[i].second;
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to write baked walkmesh file '" + filename + "'");
+    }
+}
+
+WalkMeshes::Stamp WalkMeshes::stamp(std::string const &filename) {
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(filename.c_str(), &info) != 0) return Stamp();
+#else
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return Stamp();
+#endif
+    Stamp ret;
+    ret.size = uint64_t(info.st_size);
+    ret.time = int64_t(info.st_mtime) * 1000000000;
+#if defined(__APPLE__)
+    ret.time += int64_t(info.st_mtimespec.tv_nsec);
+#elif !defined(_WIN32)
+    ret.time += int64_t(info.st_mtim.tv_nsec);
+#endif
+    return ret;
+}
+
+WalkMeshes WalkMeshes::load_cached(std::string const &filename, std::string baked) {
+    if (baked.empty()) baked = filename + ".baked";
+    Stamp source = stamp(filename);
+    
+    //the baked copy, if it's there and was made from the file as it is now:
+    auto try_baked = [&](WalkMeshes *to) {
+        if (stamp(baked).size == 0) return false;
+        try {
+            WalkMeshes cached(baked);
+            if (cached.source_stamp.size != source.size || cached.source_stamp.time != source.time) return false;
+            *to = std::move(cached);
+            return true;
+        } catch (std::exception const &e) {
+            std::cerr << "WARNING: ignoring baked walkmesh file '" << baked << "': " << e.what() << std::endl;
+            return false;
+        }
+    };
+    
+    WalkMeshes ret;
+    if (try_baked(&ret)) return ret;
+    
+    //only one process builds the baked copy; any others starting at the same time wait for it and then map it:
+    // (if there's nowhere to put a lock file, there's likely nowhere to put the baked copy either, but try anyway)
+    std::unique_ptr<FileLock> lock;
+    try {
+        lock = std::make_unique<FileLock>(baked + ".lock");
+    } catch (std::exception const &e) {
+        std::cerr << "WARNING: " << e.what() << std::endl;
+    }
+    if (lock && try_baked(&ret)) return ret;
+    
+    WalkMeshes loaded(filename);
+    
+    //write to a temporary file and then rename it, so that other processes never see a partly-written file:
+    std::string temp = baked + "." + std::to_string(std::random_device()()) + ".tmp";
+    try {
+        loaded.write_baked(temp, source);
+#ifdef _WIN32
+        std::remove(baked.c_str()); //(rename won't replace a file on windows)
+#endif
+        if (std::rename(temp.c_str(), baked.c_str()) != 0) {
+            throw std::runtime_error("Failed to rename '" + temp + "' to '" + baked + "'");
+        }
+        //use the baked copy (rather than what was just built) so that this process shares its pages too:
+        return WalkMeshes(baked);
+    } catch (std::exception const &e) {
+        std::remove(temp.c_str());
+        std::cerr << "WARNING: couldn't bake '" << filename << "' (" << e.what() << "), using it as loaded." << std::endl;
+        return loaded;
+    }
+}
 
 WalkMeshes::WalkMeshes(std::string const &filename) {
     std::ifstream file(filename, std::ios::binary);
     
+    //baked files are mapped rather than read:
+    char magic[4] = {'\0', '\0', '\0', '\0'};
+    if (file.read(magic, 4) && std::string(magic, 4) == "wbk0") {
+        file.close();
+        load_baked(filename);
+        return;
+    }
+    file.clear();
+    file.seekg(0);
+    
     std::vector<glm::vec3> vertices;
     read_chunk(file, "p...", &vertices);
     
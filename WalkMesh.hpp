@@ -1,11 +1,16 @@
 #pragma once
 
 #include <glm/glm.hpp>
-#include <glm/gtx/hash.hpp> //allows the use of 'uvec2' as an unordered_map key
+#include <glm/gtc/quaternion.hpp>
 
 #include <vector>
+#include <array>
 #include <string>
 #include <unordered_map>
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
 
 //"WalkPoint" represents location on the WalkMesh as barycentric coordinates on a triangle:
 struct WalkPoint {
@@ -13,29 +18,110 @@ struct WalkPoint {
     glm::uvec3 indices = glm::uvec3(-1U);
     //barycentric coordinates for current point:
     glm::vec3 weights = glm::vec3(std::numeric_limits<float>::quiet_NaN());
+    //index of current triangle in WalkMesh::triangles, if known (-1U if not -- WalkMesh will look it up when it needs it):
+    uint32_t triangle = -1U;
     
     //NOTE: by convention, if WalkPoint is on an edge, indices/weights will be arranged so that weights.z will be 0.0.
-    WalkPoint(glm::uvec3 const &indices_, glm::vec3 const &weights_) : indices(indices_), weights(weights_) {}
+    WalkPoint(glm::uvec3 const &indices_, glm::vec3 const &weights_, uint32_t triangle_ = -1U)
+            : indices(indices_), weights(weights_), triangle(triangle_) {}
     
     WalkPoint() = default;
 };
 
+//compact form of a WalkPoint for sending over the network (8 bytes instead of 24):
+struct PackedWalkPoint {
+    //index into WalkMesh::triangles in the low 29 bits, which order the WalkPoint lists its vertices in (see WalkMesh::pack) in the high 3 bits:
+    uint32_t triangle = 0;
+    //weights.x and weights.z, scaled to [0,65535] (weights.y is whatever is left over):
+    uint16_t weight_x = 0;
+    uint16_t weight_z = 0;
+};
+static_assert(sizeof(PackedWalkPoint) == 8, "PackedWalkPoint is sent as raw bytes.");
+
+//read-only view of an array that lives somewhere else (for WalkMesh, below, which might be looking into a mapped file):
+template<typename T>
+struct ArrayView {
+    T const *first = nullptr;
+    size_t count = 0;
+    
+    ArrayView() = default;
+    ArrayView(T const *first_, size_t count_) : first(first_), count(count_) {}
+    ArrayView(std::vector<T> const &from) : first(from.data()), count(from.size()) {}
+    
+    T const &operator[](size_t i) const { return first[i]; }
+    T const *data() const { return first; }
+    T const *begin() const { return first; }
+    T const *end() const { return first + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+};
+
 struct WalkMesh {
+    //A WalkMesh's arrays are views into 'storage', which is either vectors the WalkMesh built itself (when made from
+    // vertices and triangles) or a baked file mapped into memory (see WalkMeshes). Either way it is shared between
+    // copies of the WalkMesh and never changes:
+    std::shared_ptr<void const> storage;
+    
     //Walk mesh will keep track of triangles, vertices:
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals; //normals for interpolated 'up' direction
-    std::vector<glm::uvec3> triangles; //CCW-oriented
+    ArrayView<glm::vec3> vertices;
+    ArrayView<glm::vec3> normals; //normals for interpolated 'up' direction
+    ArrayView<glm::uvec3> triangles; //CCW-oriented
+    
+    //What's over each edge of each triangle: adjacency[t][k] is across edge triangles[t][k] -> triangles[t][(k+1)%3],
+    // useful for checking what's over an edge from a given point without any lookups:
+    struct Adjacent {
+        uint32_t triangle = -1U; //the triangle on the other side (-1U if this is a boundary edge)
+        uint32_t vertex = -1U; //that triangle's vertex that isn't on the edge
+        glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //takes this triangle's normal to that triangle's normal
+    };
+    ArrayView<std::array<Adjacent, 3>> adjacency;
+    
+    //Everything walking needs to know about a triangle's shape, worked out once when the mesh is made:
+    struct TriangleFrame {
+        glm::vec3 normal; //unit face normal
+        //barycentric weights of point p in the triangle's plane (projecting p there if it's off it) are
+        // (1 - y - z, y, z) with y = dot(to_y, p - tri.x) and z = dot(to_z, p - tri.x), in triangle order:
+        glm::vec3 to_y, to_z;
+        //unit vectors in the triangle's plane, perpendicular to edge tri[k] -> tri[(k+1)%3], pointing into the triangle:
+        std::array<glm::vec3, 3> edge_in;
+    };
+    ArrayView<TriangleFrame> frames; //one per triangle
+    
+    //Every edge [a,b] of every triangle, sorted by key, used to find which triangle a WalkPoint is on when it doesn't say:
+    struct EdgeTriangle {
+        uint64_t key; //(a << 32) | b
+        uint32_t triangle;
+        uint32_t padding; //(zero -- so every byte is set when this gets written to a file)
+    };
+    ArrayView<EdgeTriangle> edge_triangles;
     
-    //This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle (a,b,c), and is useful for checking what's over an edge from a given point:
-    std::unordered_map<glm::uvec2, uint32_t> next_vertex;
+    //index of the triangle with edge a->b, or -1U if there isn't one:
+    uint32_t find_edge_triangle(uint32_t a, uint32_t b) const;
+    //index of the triangle wp is on (wp.triangle if it's set):
+    uint32_t find_triangle(WalkPoint const &wp) const;
     
-    //Construct new WalkMesh and build next_vertex structure:
+    //Bounding volume hierarchy over the triangles, so that nearest_walk_point only needs to look at triangles near the point:
+    struct BvhNode {
+        glm::vec3 min, max; //bounds of every triangle under this node
+        uint32_t first; //leaf: first entry in bvh_triangles; interior: index of the first child (the second is right after it)
+        uint32_t count; //leaf: number of triangles; interior: 0
+    };
+    ArrayView<BvhNode> bvh; //bvh[0] is the root
+    inline static constexpr uint32_t BvhMaxDepth = 63; //(nearest_walk_point's stack holds one more node than this)
+    ArrayView<uint32_t> bvh_triangles; //indices into triangles, grouped by leaf
+    
+    //Construct new WalkMesh and build adjacency structures (and the bvh):
     WalkMesh(std::vector<glm::vec3> const &vertices_, std::vector<glm::vec3> const &normals_,
              std::vector<glm::uvec3> const &triangles_);
     
+    //Empty WalkMesh, for loaders that point the views at (and set storage to) data they already have:
+    WalkMesh() = default;
+    
     //used to initialize walking -- finds the closest point on the walk mesh:
     // (should only need to call this at the start of a level)
     WalkPoint nearest_walk_point(glm::vec3 const &world_point) const;
+    //same, but by checking every triangle (slow; for checking the bvh against):
+    WalkPoint nearest_walk_point_linear(glm::vec3 const &world_point) const;
     
     
     //take a step on a triangle, stopping at edges:
@@ -67,6 +153,19 @@ struct WalkMesh {
             glm::quat *rotation     //[out] rotation over edge
     ) const;
     
+    //walk 'step' (world space) from *at: crosses edges as needed, and bounces off of boundary edges
+    // (gives up after 10 triangles, which only happens if the step is huge compared to the triangles):
+    void walk(WalkPoint *at, glm::vec3 step) const;
+    
+    //walk at[i] by steps[i] for each i in [0, count) -- same results as calling walk() on each, but steps that stay
+    // within their triangle (most of them, for things moving a tick's worth at a time) are taken several at once
+    // with SIMD, and only walkers that reach an edge go through walk():
+    void walk_many(WalkPoint *at, glm::vec3 const *steps, size_t count) const;
+    
+    //convert to/from the network form -- weights lose a little precision, but points on edges stay exactly on edges:
+    PackedWalkPoint pack(WalkPoint const &wp) const;
+    WalkPoint unpack(PackedWalkPoint const &pwp) const; //throws if pwp doesn't refer to a triangle of this mesh
+    
     //used to read back results of walking:
     glm::vec3 to_world_point(WalkPoint const &wp) const {
         //if you were looking here for the lesson solution, well, here you go:
@@ -86,22 +185,45 @@ struct WalkMesh {
     }
     
     //read back a triangle normal at a walkpoint:
-    glm::vec3 to_world_triangle_normal(WalkPoint const &wp) const {
-        glm::vec3 const &a = vertices[wp.indices.x];
-        glm::vec3 const &b = vertices[wp.indices.y];
-        glm::vec3 const &c = vertices[wp.indices.z];
-        return glm::normalize(glm::cross(b - a, c - a));
+    glm::vec3 const &to_world_triangle_normal(WalkPoint const &wp) const {
+        return frames[find_triangle(wp)].normal;
     }
     
+    //unit vector in the plane of wp's triangle, perpendicular to edge wp.indices.x -> wp.indices.y and pointing into
+    // the triangle (for bouncing off of boundary edges):
+    glm::vec3 const &edge_in(WalkPoint const &wp) const;
+    
 };
 
 struct WalkMeshes {
-    //load a list of named WalkMeshes from a file:
+    //load a list of named WalkMeshes from a file, either as exported by export-walkmeshes.py (the meshes are built in
+    // memory) or as written by write_baked (the file is mapped and the meshes look straight into it):
     explicit WalkMeshes(std::string const &filename);
     
+    WalkMeshes() = default;
+    
+    //load an exported file by way of a baked copy of it: if the baked copy was made from the file as it is now, just
+    // map it; otherwise load the exported file and (try to) write a new baked copy. The baked copy goes in 'baked'
+    // (by default, filename + ".baked"); processes that start together take turns, so only the first one builds it:
+    static WalkMeshes load_cached(std::string const &filename, std::string baked = "");
+    
+    //write every mesh -- including everything derived from the triangles (frames, adjacency, bvh) -- to a file that
+    // can be mapped and used as-is; 'source_stamp' is recorded so that load_cached can tell if the file is stale:
+    // (the layout is whatever this build's structures are, so baked files aren't meant to be moved between machines)
+    struct Stamp {
+        uint64_t size = 0;
+        int64_t time = 0; //(nanoseconds, where the platform keeps them -- files rewritten within a second still differ)
+    };
+    void write_baked(std::string const &filename, Stamp const &source_stamp) const;
+    
+    //size and modification time of a file (all zero if it doesn't exist):
+    static Stamp stamp(std::string const &filename);
+    
     //retrieve a WalkMesh by name:
     WalkMesh const &lookup(std::string const &name) const;
     
     //internals:
     std::unordered_map<std::string, WalkMesh> meshes;
+    Stamp source_stamp; //(baked files only) the stamp the file was baked with
+    void load_baked(std::string const &filename);
 };
@@ -0,0 +1,76 @@
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(uint32_t thread_count) {
+    threads.reserve(thread_count);
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(&WorkerPool::worker_main, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::parallel_for(size_t count, std::function<void(size_t, size_t)> const &fn, size_t min_chunk) {
+    if (count == 0) return;
+    min_chunk = std::max(size_t(1), min_chunk);
+    if (threads.empty() || count <= min_chunk) {
+        fn(0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        job_count = count;
+        //a few chunks per thread, so a slow chunk doesn't hold everyone up:
+        job_chunk = std::max(min_chunk, count / (size() * 8));
+        next_begin.store(0);
+        busy = uint32_t(threads.size());
+        generation += 1;
+    }
+    wake.notify_all();
+
+    run_chunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return busy == 0; });
+    job = nullptr;
+}
+
+void WorkerPool::run_chunks() {
+    while (true) {
+        size_t begin = next_begin.fetch_add(job_chunk);
+        if (begin >= job_count) break;
+        (*job)(begin, std::min(job_count, begin + job_chunk));
+    }
+}
+
+void WorkerPool::worker_main() {
+    uint32_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return quit || generation != seen; });
+            if (quit) return;
+            seen = generation;
+        }
+
+        run_chunks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy -= 1;
+            if (busy == 0) done.notify_one();
+        }
+    }
+}
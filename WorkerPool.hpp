@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+ * WorkerPool is a fixed set of threads that split up loops:
+ *
+ *  WorkerPool workers(3); //three helper threads (plus the calling thread)
+ *  workers.parallel_for(items.size(), [&](size_t begin, size_t end) {
+ *      for (size_t i = begin; i < end; ++i) update(items[i]);
+ *  });
+ *
+ * parallel_for blocks until the whole range is done. The calling thread works
+ * on the range too, so a pool with zero threads just runs the loop inline.
+ * Which thread gets which chunk is not deterministic, so the loop body should
+ * only write to data owned by its own indices.
+ *
+ * A pool runs one parallel_for at a time: the loop body must not call
+ * parallel_for on the same pool.
+ */
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+struct WorkerPool {
+    explicit WorkerPool(uint32_t thread_count);
+    ~WorkerPool();
+
+    //threads are tied to this object, so no copying:
+    WorkerPool(WorkerPool const &) = delete;
+    WorkerPool &operator=(WorkerPool const &) = delete;
+
+    //number of threads that work on a parallel_for (including the caller):
+    uint32_t size() const { return uint32_t(threads.size()) + 1; }
+
+    //call fn(begin, end) on chunks covering [0, count), spread across the pool; returns when all chunks are done:
+    // (min_chunk is the smallest chunk worth handing to a thread -- pass something smaller when each item is a lot of work)
+    void parallel_for(size_t count, std::function<void(size_t begin, size_t end)> const &fn, size_t min_chunk = MinChunk);
+
+    //ranges shorter than this aren't worth waking the threads up for:
+    inline static constexpr size_t MinChunk = 64;
+
+    //internals:
+    void worker_main();
+    void run_chunks();
+
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake; //signaled when a new job is posted (or on quit)
+    std::condition_variable done; //signaled when the last busy worker finishes
+
+    //current job (written under mutex before bumping generation):
+    std::function<void(size_t, size_t)> const *job = nullptr;
+    size_t job_count = 0;
+    size_t job_chunk = 0;
+    std::atomic<size_t> next_begin{0};
+
+    uint32_t generation = 0; //incremented for every job
+    uint32_t busy = 0; //workers still running the current job
+    bool quit = false;
+};
@@ -0,0 +1,1312 @@
+#include "Game.hpp"
+#include "Connection.hpp"
+#include "WorkerPool.hpp"
+#include "NetworkThread.hpp"
+#include "MatchManager.hpp"
+#include "data_path.hpp"
+#include "read_write_chunk.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <mutex>
+#include <atomic>
+#endif
+
+//Server-side benchmarks; run "./bench" for a list.
+
+//run 'step' until it has been run 'iterations' times or 'budget' seconds have passed (but at least once),
+// returns average seconds per step:
+static double time_steps(size_t iterations, double budget, std::function<void()> const &step) {
+    auto before = std::chrono::steady_clock::now();
+    size_t done = 0;
+    double elapsed = 0.0;
+    while (done < iterations) {
+        step();
+        done += 1;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+        if (elapsed > budget) break;
+    }
+    return elapsed / double(done);
+}
+
+//everything queued to be sent on a connection, as one buffer (and clear the connection's queue):
+static std::vector<uint8_t> take_sent(Connection &connection) {
+    std::vector<uint8_t> sent;
+    for (auto const &buffer: connection.send_queue) {
+        sent.insert(sent.end(), buffer->begin(), buffer->end());
+    }
+    sent.insert(sent.end(), connection.send_buffer.begin(), connection.send_buffer.end());
+    connection.send_queue.clear();
+    connection.send_buffer.clear();
+    return sent;
+}
+
+//replace whatever a connection has received with 'data':
+static void set_received(Connection &connection, std::vector<uint8_t> const &data) {
+    connection.recv_buffer.clear();
+    connection.recv_buffer.append(data.data(), data.size());
+}
+
+//Game::update at various herd sizes, spatial hash vs. the all-pairs loop:
+static void bench_tick(size_t ticks, std::vector<size_t> const &sheep_counts) {
+    std::cout << "Game::update (ms per tick, " << ticks << " ticks or 10s budget):" << std::endl;
+    std::cout << std::setw(8) << "sheep" << std::setw(14) << "all-pairs" << std::setw(14) << "hash"
+              << std::setw(10) << "speedup" << std::endl;
+
+    for (size_t sheep_count: sheep_counts) {
+        Game game(sheep_count);
+        //a few players standing around in the herd:
+        for (uint32_t p = 0; p < 16; ++p) {
+            game.spawn_player();
+        }
+
+        //both variants start from the same state:
+        Game all_pairs = game;
+        all_pairs.use_spatial_hash = false;
+
+        double all_pairs_time = time_steps(ticks, 10.0, [&]() { all_pairs.update(Game::Tick); });
+        double hash_time = time_steps(ticks, 10.0, [&]() { game.update(Game::Tick); });
+
+        std::cout << std::setw(8) << sheep_count
+                  << std::setw(14) << std::fixed << std::setprecision(3) << all_pairs_time * 1000.0
+                  << std::setw(14) << std::fixed << std::setprecision(3) << hash_time * 1000.0
+                  << std::setw(9) << std::fixed << std::setprecision(1) << all_pairs_time / hash_time << "x"
+                  << std::endl;
+    }
+}
+
+//a bumpy square walkmesh with about 'triangle_count' triangles (z is up):
+static WalkMesh make_test_walkmesh(size_t triangle_count) {
+    auto side = uint32_t(std::max(2.0, std::ceil(std::sqrt(double(triangle_count) / 2.0)) + 1.0)); //(vertices per side)
+    auto height = [](float x, float y) { return 0.5f * std::sin(x * 0.3f) * std::cos(y * 0.2f); };
+    std::vector<glm::vec3> vertices;
+    std::vector<glm::vec3> normals;
+    for (uint32_t y = 0; y < side; ++y) {
+        for (uint32_t x = 0; x < side; ++x) {
+            vertices.emplace_back(float(x), float(y), height(float(x), float(y)));
+            glm::vec3 dx(1.0f, 0.0f, height(float(x) + 0.5f, float(y)) - height(float(x) - 0.5f, float(y)));
+            glm::vec3 dy(0.0f, 1.0f, height(float(x), float(y) + 0.5f) - height(float(x), float(y) - 0.5f));
+            normals.emplace_back(glm::normalize(glm::cross(dx, dy)));
+        }
+    }
+    std::vector<glm::uvec3> triangles;
+    for (uint32_t y = 0; y + 1 < side; ++y) {
+        for (uint32_t x = 0; x + 1 < side; ++x) {
+            uint32_t i = y * side + x;
+            triangles.emplace_back(i, i + 1, i + side + 1);
+            triangles.emplace_back(i, i + side + 1, i + side);
+        }
+    }
+    return WalkMesh(vertices, normals, triangles);
+}
+
+//WalkMesh::nearest_walk_point with the bvh vs. checking every triangle, on the game's walkmesh and on bigger ones:
+static void bench_nearest(size_t queries, std::vector<size_t> const &triangle_counts) {
+    std::cout << "WalkMesh::nearest_walk_point (" << queries << " random points or 10s budget):" << std::endl;
+    std::cout << std::setw(10) << "triangles" << std::setw(16) << "construct (ms)" << std::setw(14) << "linear (us)"
+              << std::setw(14) << "bvh (us)" << std::setw(10) << "speedup" << std::setw(11) << "agree" << std::endl;
+
+    Game game(0);
+    std::vector<WalkMesh const *> walkmeshes{game.walkmesh};
+    std::vector<std::unique_ptr<WalkMesh>> made;
+    std::vector<double> build_times{0.0};
+    for (size_t triangle_count: triangle_counts) {
+        auto before = std::chrono::steady_clock::now();
+        made.emplace_back(std::make_unique<WalkMesh>(make_test_walkmesh(triangle_count)));
+        build_times.emplace_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count());
+        walkmeshes.emplace_back(made.back().get());
+    }
+
+    for (size_t m = 0; m < walkmeshes.size(); ++m) {
+        WalkMesh const &walkmesh = *walkmeshes[m];
+
+        //random points in (and a bit around) the walkmesh's bounds:
+        glm::vec3 min = walkmesh.bvh[0].min - glm::vec3(1.0f);
+        glm::vec3 max = walkmesh.bvh[0].max + glm::vec3(1.0f);
+        Rng rng(0x5eed + uint32_t(m));
+        std::vector<glm::vec3> points;
+        for (size_t i = 0; i < queries; ++i) {
+            points.emplace_back(glm::mix(min, max, glm::vec3(rng.unit(), rng.unit(), rng.unit())));
+        }
+
+        std::vector<WalkPoint> linear(points.size());
+        std::vector<WalkPoint> bvh(points.size());
+        size_t linear_done = 0;
+        double linear_time = time_steps(points.size(), 10.0, [&]() {
+            linear[linear_done] = walkmesh.nearest_walk_point_linear(points[linear_done]);
+            linear_done += 1;
+        });
+        size_t bvh_done = 0;
+        double bvh_time = time_steps(points.size(), 10.0, [&]() {
+            bvh[bvh_done] = walkmesh.nearest_walk_point(points[bvh_done]);
+            bvh_done += 1;
+        });
+
+        //(ties can be broken differently, so compare distances rather than triangles)
+        size_t agree = 0;
+        for (size_t i = 0; i < linear_done; ++i) {
+            float linear_dis = glm::length(points[i] - walkmesh.to_world_point(linear[i]));
+            float bvh_dis = glm::length(points[i] - walkmesh.to_world_point(bvh[i]));
+            if (std::abs(linear_dis - bvh_dis) <= 1e-4f) agree += 1;
+        }
+
+        std::cout << std::setw(10) << walkmesh.triangles.size()
+                  << std::setw(16) << std::fixed << std::setprecision(3) << build_times[m] * 1000.0
+                  << std::setw(14) << std::fixed << std::setprecision(3) << linear_time * 1e6
+                  << std::setw(14) << std::fixed << std::setprecision(3) << bvh_time * 1e6
+                  << std::setw(9) << std::fixed << std::setprecision(1) << linear_time / bvh_time << "x"
+                  << std::setw(11) << (std::to_string(agree) + "/" + std::to_string(linear_done))
+                  << (m == 0 ? "  (game)" : "") << std::endl;
+    }
+}
+
+//loading walkmeshes from an exported file (read, copied, and built in memory) vs. from a baked copy (mapped):
+static void bench_load(size_t iterations, std::vector<size_t> const &triangle_counts) {
+    std::cout << "WalkMeshes loading (ms per load, " << iterations << " loads or 10s budget):" << std::endl;
+    std::cout << std::setw(10) << "triangles" << std::setw(14) << "file (KiB)" << std::setw(14) << "baked (KiB)"
+              << std::setw(12) << "exported" << std::setw(10) << "bake" << std::setw(10) << "baked"
+              << std::setw(10) << "speedup" << std::setw(11) << "agree" << std::endl;
+
+    //the game's walkmesh file, then test meshes written out the same way export-walkmeshes.py would:
+    std::vector<std::string> filenames{data_path("world.w")};
+    for (size_t triangle_count: triangle_counts) {
+        WalkMesh walkmesh = make_test_walkmesh(triangle_count);
+        std::string filename = data_path("bench-" + std::to_string(triangle_count) + ".w");
+        std::ofstream file(filename, std::ios::binary);
+        write_chunk("p...", std::vector<glm::vec3>(walkmesh.vertices.begin(), walkmesh.vertices.end()), &file);
+        write_chunk("n...", std::vector<glm::vec3>(walkmesh.normals.begin(), walkmesh.normals.end()), &file);
+        write_chunk("tri0", std::vector<glm::uvec3>(walkmesh.triangles.begin(), walkmesh.triangles.end()), &file);
+        std::string name = "WalkMesh";
+        write_chunk("str0", std::vector<char>(name.begin(), name.end()), &file);
+        std::vector<uint32_t> index{0, uint32_t(name.size()), 0, uint32_t(walkmesh.vertices.size()),
+                                    0, uint32_t(walkmesh.triangles.size())};
+        write_chunk("idxA", index, &file);
+        filenames.emplace_back(filename);
+    }
+
+    for (size_t f = 0; f < filenames.size(); ++f) {
+        std::string const &filename = filenames[f];
+        std::string baked = filename + ".bench-baked";
+
+        double exported_time = time_steps(iterations, 10.0, [&]() { WalkMeshes walkmeshes(filename); });
+        WalkMeshes exported(filename);
+        double bake_time = time_steps(1, 10.0, [&]() { exported.write_baked(baked, WalkMeshes::stamp(filename)); });
+        //(the file is in the page cache after being written, so this is what every process after the first sees)
+        double baked_time = time_steps(iterations, 10.0, [&]() { WalkMeshes walkmeshes(baked); });
+
+        //should be the very same mesh:
+        WalkMesh const &a = exported.lookup("WalkMesh");
+        WalkMeshes mapped(baked);
+        WalkMesh const &b = mapped.lookup("WalkMesh");
+        Rng rng(0x5eed);
+        size_t agree = 0;
+        const size_t Queries = 100;
+        for (size_t i = 0; i < Queries; ++i) {
+            glm::vec3 point = glm::mix(a.bvh[0].min, a.bvh[0].max, glm::vec3(rng.unit(), rng.unit(), rng.unit()));
+            WalkPoint pa = a.nearest_walk_point(point);
+            WalkPoint pb = b.nearest_walk_point(point);
+            if (std::memcmp(&pa, &pb, sizeof(WalkPoint)) == 0) agree += 1;
+        }
+
+        std::cout << std::setw(10) << a.triangles.size()
+                  << std::setw(14) << WalkMeshes::stamp(filename).size / 1024
+                  << std::setw(14) << WalkMeshes::stamp(baked).size / 1024
+                  << std::setw(12) << std::fixed << std::setprecision(3) << exported_time * 1000.0
+                  << std::setw(10) << std::fixed << std::setprecision(3) << bake_time * 1000.0
+                  << std::setw(10) << std::fixed << std::setprecision(3) << baked_time * 1000.0
+                  << std::setw(9) << std::fixed << std::setprecision(1) << exported_time / baked_time << "x"
+                  << std::setw(11) << (std::to_string(agree) + "/" + std::to_string(Queries))
+                  << (f == 0 ? "  (game)" : "") << std::endl;
+
+        std::remove(baked.c_str());
+        if (f != 0) std::remove(filename.c_str());
+    }
+}
+
+//WalkMesh::walk on each walker vs. WalkMesh::walk_many on all of them, with sheep-sized steps on the game's walkmesh:
+static void bench_walk(size_t ticks, std::vector<size_t> const &walker_counts) {
+    std::cout << "WalkMesh::walk vs. walk_many (" << ticks << " ticks or 10s budget), millions of walker-steps per second:"
+              << std::endl;
+    std::cout << std::setw(10) << "walkers" << std::setw(12) << "walk" << std::setw(14) << "walk_many"
+              << std::setw(10) << "speedup" << std::setw(12) << "identical" << std::endl;
+
+    Game game(0);
+    WalkMesh const &walkmesh = *game.walkmesh;
+    glm::vec3 min = walkmesh.bvh[0].min;
+    glm::vec3 max = walkmesh.bvh[0].max;
+
+    for (size_t walker_count: walker_counts) {
+        //walkers scattered over the mesh, each heading its own way at sheep speed:
+        Rng rng(0x5eed + uint32_t(walker_count));
+        std::vector<WalkPoint> at;
+        std::vector<glm::vec3> steps;
+        for (size_t i = 0; i < walker_count; ++i) {
+            at.emplace_back(walkmesh.nearest_walk_point(glm::mix(min, max, glm::vec3(rng.unit(), rng.unit(), 0.5f))));
+            float angle = rng.unit() * 2.0f * glm::pi<float>();
+            steps.emplace_back(glm::vec3(std::cos(angle), std::sin(angle), 0.0f) * Game::SheepSpeed * Game::Tick);
+        }
+        std::vector<WalkPoint> at_many = at;
+
+        //run both for the same number of ticks so the results can be compared:
+        size_t one_ticks = 0;
+        double one_time = time_steps(ticks, 10.0, [&]() {
+            for (size_t i = 0; i < at.size(); ++i) {
+                walkmesh.walk(&at[i], steps[i]);
+            }
+            one_ticks += 1;
+        });
+        auto before = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < one_ticks; ++t) {
+            walkmesh.walk_many(at_many.data(), steps.data(), at_many.size());
+        }
+        double many_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count()
+                           / double(one_ticks);
+
+        bool identical = (std::memcmp(at.data(), at_many.data(), at.size() * sizeof(WalkPoint)) == 0);
+
+        std::cout << std::setw(10) << walker_count
+                  << std::setw(12) << std::fixed << std::setprecision(2) << double(walker_count) / one_time * 1e-6
+                  << std::setw(14) << std::fixed << std::setprecision(2) << double(walker_count) / many_time * 1e-6
+                  << std::setw(9) << std::fixed << std::setprecision(1) << one_time / many_time << "x"
+                  << std::setw(12) << (identical ? "yes" : "NO") << std::endl;
+    }
+}
+
+//Game::send_state_message / Game::recv_state_message for one client at various herd sizes, for each protocol version
+// (along with how far off the decoded positions and rotations are):
+static void bench_state(size_t iterations, std::vector<size_t> const &sheep_counts) {
+    std::cout << "State messages (" << iterations << " iterations or 10s budget):" << std::endl;
+    std::cout << std::setw(8) << "sheep" << std::setw(9) << "version" << std::setw(12) << "bytes"
+              << std::setw(14) << "send (ms)" << std::setw(14) << "recv (ms)"
+              << std::setw(14) << "max err (m)" << std::setw(16) << "max err (deg)" << std::endl;
+
+    for (size_t sheep_count: sheep_counts) {
+        Game game(sheep_count);
+        for (uint32_t p = 0; p < 16; ++p) {
+            game.spawn_player();
+        }
+        game.update(Game::Tick); //(records the snapshot that gets sent)
+
+        for (uint8_t version = 0; version <= Game::ProtocolVersion; ++version) {
+            Game client(0);
+
+            Connection connection;
+            double send_time = time_steps(iterations, 10.0, [&]() {
+                game.shared.clear(); //(so every iteration actually encodes)
+                connection.send_queue.clear();
+                connection.send_buffer.clear();
+                game.send_state_message(&connection, Player::Handle(), 0, version);
+            });
+            std::vector<uint8_t> sent = take_sent(connection);
+            size_t bytes = sent.size();
+            double recv_time = time_steps(iterations, 10.0, [&]() {
+                set_received(connection, sent);
+                if (!client.recv_state_message(&connection)) {
+                    throw std::runtime_error("Failed to decode state message.");
+                }
+            });
+
+            float max_distance = 0.0f;
+            float max_angle = 0.0f;
+            for (size_t i = 0; i < sheep_count; ++i) {
+                max_distance = std::max(max_distance, glm::distance(
+                        game.walkmesh->to_world_point(game.sheeps.at[i]),
+                        client.walkmesh->to_world_point(client.sheeps.at[i])
+                ));
+                //(for unit quaternions, |a - b| = 2 sin(angle / 4) -- better behaved than acos of the dot product for small angles)
+                glm::quat const &a = game.sheeps.rotation[i];
+                glm::quat b = client.sheeps.rotation[i];
+                if (glm::dot(a, b) < 0.0f) b = -b;
+                float chord = std::min(2.0f, glm::length(glm::quat(a.w - b.w, a.x - b.x, a.y - b.y, a.z - b.z)));
+                max_angle = std::max(max_angle, glm::degrees(4.0f * std::asin(0.5f * chord)));
+            }
+
+            std::cout << std::setw(8) << sheep_count << std::setw(9) << int(version) << std::setw(12) << bytes
+                      << std::setw(14) << std::fixed << std::setprecision(3) << send_time * 1000.0
+                      << std::setw(14) << std::fixed << std::setprecision(3) << recv_time * 1000.0
+                      << std::setw(14) << std::fixed << std::setprecision(5) << max_distance
+                      << std::setw(16) << std::fixed << std::setprecision(3) << max_angle
+                      << std::endl;
+        }
+    }
+}
+
+//state messages in a crowded game, for each protocol version -- checking that every player a version can count
+// arrives (all of them from version 3; at most Game::LegacyMaxPlayers before that), with the client's own player first:
+static void bench_players(size_t iterations, std::vector<size_t> const &player_counts) {
+    std::cout << "State messages with many players (" << iterations << " iterations or 10s budget):" << std::endl;
+    std::cout << std::setw(8) << "players" << std::setw(9) << "version" << std::setw(12) << "bytes"
+              << std::setw(14) << "send (ms)" << std::setw(14) << "recv (ms)"
+              << std::setw(10) << "decoded" << std::setw(8) << "you" << std::endl;
+
+    for (size_t player_count: player_counts) {
+        Game game(Game::SheepCount, 0x5eed);
+        Player::Handle last;
+        for (size_t p = 0; p < player_count; ++p) {
+            last = game.spawn_player();
+        }
+        game.update(Game::Tick);
+        //(the client is the last player to join, so older versions have to make room for it)
+        uint32_t last_id = game.players.id[game.players.index(last)];
+
+        for (uint8_t version = 0; version <= Game::ProtocolVersion; ++version) {
+            Game client(0);
+
+            Connection connection;
+            double send_time = time_steps(iterations, 10.0, [&]() {
+                game.shared.clear(); //(so every iteration actually encodes)
+                connection.send_queue.clear();
+                connection.send_buffer.clear();
+                game.send_state_message(&connection, last, 0, version);
+            });
+            std::vector<uint8_t> sent = take_sent(connection);
+            size_t bytes = sent.size();
+            double recv_time = time_steps(iterations, 10.0, [&]() {
+                set_received(connection, sent);
+                if (!client.recv_state_message(&connection)) {
+                    throw std::runtime_error("Failed to decode state message.");
+                }
+            });
+
+            size_t expected = (version >= 3 ? player_count : std::min(player_count, Game::LegacyMaxPlayers));
+            bool you_first = (client.players.size() != 0 && client.players.id[0] == last_id);
+            if (client.players.size() != expected || !you_first) {
+                throw std::runtime_error("Decoded " + std::to_string(client.players.size()) + " of "
+                                         + std::to_string(player_count) + " players with protocol version "
+                                         + std::to_string(version) + (you_first ? "." : ", without the client's own first."));
+            }
+
+            std::cout << std::setw(8) << player_count << std::setw(9) << int(version) << std::setw(12) << bytes
+                      << std::setw(14) << std::fixed << std::setprecision(3) << send_time * 1000.0
+                      << std::setw(14) << std::fixed << std::setprecision(3) << recv_time * 1000.0
+                      << std::setw(10) << client.players.size() << std::setw(8) << (you_first ? "first" : "NO")
+                      << std::endl;
+        }
+    }
+}
+
+//bytes per tick for full state messages vs. deltas against the last acknowledged state:
+static void bench_delta(size_t ticks, std::vector<size_t> const &sheep_counts) {
+    std::cout << "State message bytes per tick (" << ticks << " ticks), full vs. delta:" << std::endl;
+    std::cout << std::setw(8) << "sheep" << std::setw(12) << "full" << std::setw(12) << "delta"
+              << std::setw(10) << "ratio" << std::setw(12) << "identical" << std::endl;
+
+    for (size_t sheep_count: sheep_counts) {
+        Game game(sheep_count, 0x5eed);
+        for (uint32_t p = 0; p < 16; ++p) {
+            game.spawn_player();
+        }
+        Game full_client(0);
+        Game delta_client(0);
+
+        Connection full_connection, delta_connection;
+        size_t full_bytes = 0, delta_bytes = 0;
+        uint32_t acked = 0;
+        bool identical = true;
+        for (size_t t = 0; t < ticks; ++t) {
+            game.update(Game::Tick);
+
+            game.send_state_message(&full_connection);
+            set_received(full_connection, take_sent(full_connection));
+            full_bytes += full_connection.recv_buffer.size();
+
+            game.send_state_message(&delta_connection, Player::Handle(), acked);
+            set_received(delta_connection, take_sent(delta_connection));
+            delta_bytes += delta_connection.recv_buffer.size();
+
+            if (!full_client.recv_state_message(&full_connection)
+                || !delta_client.recv_state_message(&delta_connection)) {
+                throw std::runtime_error("Failed to decode state message.");
+            }
+
+            //(acknowledge immediately -- i.e., a client with no packet loss and less than a tick of latency)
+            delta_client.send_ack_message(&delta_connection);
+            set_received(delta_connection, take_sent(delta_connection));
+            if (!Game::recv_ack_message(&delta_connection, &acked)) {
+                throw std::runtime_error("Failed to decode ack message.");
+            }
+
+            if (full_client.sheeps.at.size() != delta_client.sheeps.at.size()
+                || std::memcmp(full_client.sheeps.at.data(), delta_client.sheeps.at.data(), sizeof(WalkPoint) * sheep_count) != 0
+                || std::memcmp(full_client.sheeps.rotation.data(), delta_client.sheeps.rotation.data(), sizeof(glm::quat) * sheep_count) != 0
+                || full_client.players.name != delta_client.players.name) {
+                identical = false;
+            }
+        }
+
+        std::cout << std::setw(8) << sheep_count
+                  << std::setw(12) << full_bytes / ticks
+                  << std::setw(12) << delta_bytes / ticks
+                  << std::setw(9) << std::fixed << std::setprecision(1) << double(full_bytes) / double(delta_bytes) << "x"
+                  << std::setw(12) << (identical ? "yes" : "NO") << std::endl;
+    }
+}
+
+//sending one tick's state to many clients: each encoded separately (as in protocol version 1) vs. one shared encoding:
+static void bench_fanout(size_t ticks, std::vector<size_t> const &sheep_counts) {
+    const size_t Clients = 64;
+    std::cout << "Sending state to " << Clients << " clients (ms per tick, " << ticks << " ticks or 10s budget):" << std::endl;
+    std::cout << std::setw(8) << "sheep" << std::setw(14) << "per-client" << std::setw(14) << "shared"
+              << std::setw(10) << "speedup" << std::endl;
+
+    for (size_t sheep_count: sheep_counts) {
+        Game game(sheep_count);
+        std::vector<Player::Handle> handles;
+        for (uint32_t p = 0; p < Clients; ++p) {
+            handles.emplace_back(game.spawn_player());
+        }
+        game.update(Game::Tick);
+
+        std::vector<Connection> connections(Clients);
+        auto send_all = [&](uint8_t version) {
+            game.shared.clear(); //(as if it were a new tick)
+            for (size_t c = 0; c < Clients; ++c) {
+                game.send_state_message(&connections[c], handles[c], 0, version);
+            }
+            //(sending would happen here; just drop the data)
+            for (auto &connection: connections) {
+                connection.send_queue.clear();
+                connection.send_buffer.clear();
+            }
+        };
+        double per_client_time = time_steps(ticks, 10.0, [&]() { send_all(1); });
+        double shared_time = time_steps(ticks, 10.0, [&]() { send_all(2); });
+
+        std::cout << std::setw(8) << sheep_count
+                  << std::setw(14) << std::fixed << std::setprecision(3) << per_client_time * 1000.0
+                  << std::setw(14) << std::fixed << std::setprecision(3) << shared_time * 1000.0
+                  << std::setw(9) << std::fixed << std::setprecision(1) << per_client_time / shared_time << "x"
+                  << std::endl;
+    }
+}
+
+//handling a backlog of messages that piled up in a connection's recv_buffer
+// (vs. how it used to work -- erasing each message from the front of a std::vector):
+static void bench_backlog(size_t iterations, std::vector<size_t> const &message_counts) {
+    std::cout << "Handling a backlog of controls messages (ms, " << iterations << " iterations or 10s budget):" << std::endl;
+    std::cout << std::setw(10) << "messages" << std::setw(14) << "vector" << std::setw(14) << "ByteBuffer"
+              << std::setw(10) << "speedup" << std::endl;
+
+    for (size_t message_count: message_counts) {
+        Player::Controls controls;
+        Connection connection;
+        for (size_t m = 0; m < message_count; ++m) {
+            controls.send_controls_message(&connection);
+        }
+        std::vector<uint8_t> backlog = take_sent(connection);
+        size_t message_size = backlog.size() / message_count;
+
+        std::vector<uint8_t> vector;
+        double vector_time = time_steps(iterations, 10.0, [&]() {
+            vector = backlog;
+            while (!vector.empty()) {
+                vector.erase(vector.begin(), vector.begin() + message_size);
+            }
+        });
+
+        double buffer_time = time_steps(iterations, 10.0, [&]() {
+            set_received(connection, backlog);
+            while (controls.recv_controls_message(&connection)) {
+                controls.left.downs = controls.right.downs = controls.up.downs = controls.down.downs = 0;
+            }
+            if (!connection.recv_buffer.empty()) throw std::runtime_error("Failed to handle backlog.");
+        });
+
+        std::cout << std::setw(10) << message_count
+                  << std::setw(14) << std::fixed << std::setprecision(3) << vector_time * 1000.0
+                  << std::setw(14) << std::fixed << std::setprecision(3) << buffer_time * 1000.0
+                  << std::setw(9) << std::fixed << std::setprecision(1) << vector_time / buffer_time << "x"
+                  << std::endl;
+    }
+}
+
+#ifndef _WIN32
+//address to connect to a (local) server on:
+static socklen_t server_address(Server const &server, sockaddr_storage *address) {
+    socklen_t address_size = sizeof(*address);
+    getsockname(server.listen_socket, reinterpret_cast<sockaddr *>(address), &address_size);
+    if (address->ss_family == AF_INET) {
+        reinterpret_cast<sockaddr_in *>(address)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    } else {
+        reinterpret_cast<sockaddr_in6 *>(address)->sin6_addr = in6addr_loopback;
+    }
+    return address_size;
+}
+
+static char const *backend_name(Server::Backend backend) {
+    if (backend == Server::Backend::Select) return "select";
+    if (backend == Server::Backend::Epoll) return "epoll";
+    return "io_uring";
+}
+
+//a server with lots of (local) clients connected, for each of the Server's polling backends:
+static void bench_connections(size_t rounds, std::vector<size_t> const &client_counts) {
+    std::cout << "Server::poll with many local clients (" << rounds << " rounds or 10s budget):" << std::endl;
+    std::cout << std::setw(8) << "clients" << std::setw(9) << "backend" << std::setw(14) << "connect (ms)"
+              << std::setw(14) << "idle (ms)" << std::setw(14) << "round (ms)" << std::endl;
+
+    //(the server logs every connection; that's a lot of noise here)
+    auto *cerr_buf = std::cerr.rdbuf(nullptr);
+
+    for (size_t client_count: client_counts) {
+        for (Server::Backend backend: {Server::Backend::Select, Server::Backend::Epoll, Server::Backend::IoUring}) {
+            char const *name = backend_name(backend);
+            //(both ends of every connection are in this process, so that's two sockets per client)
+            if (backend == Server::Backend::Select && 2 * client_count + 16 > FD_SETSIZE) {
+                std::cout << std::setw(8) << client_count << std::setw(9) << name
+                          << "   (more sockets than FD_SETSIZE)" << std::endl;
+                continue;
+            }
+#ifndef __linux__
+            if (backend != Server::Backend::Select) continue;
+#endif
+
+            Server server("0", backend); //(any free port)
+            sockaddr_storage address;
+            socklen_t address_size = server_address(server, &address);
+
+            //count bytes the server got (and drop them):
+            size_t received = 0;
+            auto on_event = [&](Connection *c, Connection::Event evt) {
+                if (evt == Connection::OnRecv) {
+                    received += c->recv_buffer.size();
+                    c->recv_buffer.clear();
+                }
+            };
+
+            //connect everyone (a batch at a time, so the listen backlog doesn't overflow):
+            std::vector<int> clients;
+            auto before = std::chrono::steady_clock::now();
+            while (clients.size() < client_count) {
+                for (size_t b = 0; b < 128 && clients.size() < client_count; ++b) {
+                    int s = socket(address.ss_family, SOCK_STREAM, 0);
+                    if (s < 0 || connect(s, reinterpret_cast<sockaddr *>(&address), address_size) != 0) {
+                        std::cerr.rdbuf(cerr_buf);
+                        throw std::runtime_error("Failed to connect client " + std::to_string(clients.size()) + ": "
+                                                 + std::strerror(errno));
+                    }
+                    clients.emplace_back(s);
+                }
+                while (server.connections.size() < clients.size()) {
+                    server.poll(on_event, 0.01);
+                }
+            }
+            double connect_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+
+            //polling when nothing is happening:
+            double idle_time = time_steps(rounds, 10.0, [&]() { server.poll(on_event, 0.0); });
+
+            //a round of server -> every client, then every client -> server:
+            std::vector<uint8_t> state(64, 's');
+            std::vector<uint8_t> controls(9, 'c');
+            double round_time = time_steps(rounds, 10.0, [&]() {
+                for (auto &c: server.connections) {
+                    c.send_raw(state.data(), state.size());
+                }
+                while (std::any_of(server.connections.begin(), server.connections.end(),
+                                   [](Connection const &c) { return c.sending(); })) {
+                    server.poll(on_event, 0.01);
+                }
+                for (int s: clients) {
+                    uint8_t buffer[64];
+                    size_t got = 0;
+                    while (got < state.size()) {
+                        ssize_t ret = recv(s, buffer, state.size() - got, 0);
+                        if (ret <= 0) throw std::runtime_error("Client lost connection.");
+                        got += size_t(ret);
+                    }
+                    if (send(s, controls.data(), controls.size(), 0) != ssize_t(controls.size())) {
+                        throw std::runtime_error("Client failed to send.");
+                    }
+                }
+                size_t expected = received + controls.size() * clients.size();
+                while (received < expected) {
+                    server.poll(on_event, 0.01);
+                }
+            });
+
+            for (int s: clients) {
+                close(s);
+            }
+            while (!server.connections.empty()) {
+                server.poll(on_event, 0.01);
+            }
+            close(server.listen_socket);
+
+            std::cout << std::setw(8) << client_count << std::setw(9) << name
+                      << std::setw(14) << std::fixed << std::setprecision(3) << connect_time * 1000.0
+                      << std::setw(14) << std::fixed << std::setprecision(3) << idle_time * 1000.0
+                      << std::setw(14) << std::fixed << std::setprecision(3) << round_time * 1000.0
+                      << std::endl;
+        }
+    }
+
+    std::cerr.rdbuf(cerr_buf);
+}
+#endif
+
+#ifdef __linux__
+//state delivery to lots of (local) clients, as the server would do it every tick, for each polling backend:
+// a thread plays all the clients (reading each state message and answering with a controls message),
+// and the main thread measures how long each client took to get its state, and how many syscalls the server made.
+static void bench_delivery(size_t ticks, std::vector<size_t> const &client_counts) {
+    std::cout << "State delivery to many local clients (" << ticks << " ticks or 10s budget, 200 sheep):" << std::endl;
+    std::cout << std::setw(8) << "clients" << std::setw(10) << "backend" << std::setw(16) << "syscalls/tick"
+              << std::setw(12) << "p50 (ms)" << std::setw(12) << "p99 (ms)" << std::setw(12) << "max (ms)"
+              << std::setw(14) << "tick (ms)" << std::endl;
+
+    auto *cerr_buf = std::cerr.rdbuf(nullptr);
+
+    Game game(200, 0x5eed);
+    Player::Handle player = game.spawn_player();
+    game.update(Game::Tick); //(records a snapshot to send)
+
+    const uint8_t Controls[12] = {1, 8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; //(a controls message with nothing pressed)
+
+    for (size_t client_count: client_counts) {
+        for (Server::Backend backend: {Server::Backend::Select, Server::Backend::Epoll, Server::Backend::IoUring}) {
+            char const *name = backend_name(backend);
+            if (backend == Server::Backend::Select && client_count + 16 > FD_SETSIZE) {
+                std::cout << std::setw(8) << client_count << std::setw(10) << name
+                          << "   (more sockets than FD_SETSIZE)" << std::endl;
+                continue;
+            }
+
+            Server server("0", backend);
+            sockaddr_storage address;
+            socklen_t address_size = server_address(server, &address);
+
+            size_t received = 0;
+            auto on_event = [&](Connection *c, Connection::Event evt) {
+                if (evt == Connection::OnRecv) {
+                    received += c->recv_buffer.size();
+                    c->recv_buffer.clear();
+                }
+            };
+
+            //connect everyone; client ends get moved up past the server's sockets so select (which only
+            // sees the server's end) can handle more than FD_SETSIZE / 2 clients:
+            std::vector<int> clients;
+            while (clients.size() < client_count) {
+                for (size_t b = 0; b < 128 && clients.size() < client_count; ++b) {
+                    int s = socket(address.ss_family, SOCK_STREAM, 0);
+                    if (s < 0 || connect(s, reinterpret_cast<sockaddr *>(&address), address_size) != 0) {
+                        std::cerr.rdbuf(cerr_buf);
+                        throw std::runtime_error("Failed to connect client " + std::to_string(clients.size()) + ": "
+                                                 + std::strerror(errno));
+                    }
+                    int high = fcntl(s, F_DUPFD, FD_SETSIZE + 16);
+                    close(s);
+                    if (high < 0) {
+                        std::cerr.rdbuf(cerr_buf);
+                        throw std::runtime_error(std::string("Failed to move client socket (ulimit -n too low?): ")
+                                                 + std::strerror(errno));
+                    }
+                    clients.emplace_back(high);
+                }
+                while (server.connections.size() < clients.size()) {
+                    server.poll(on_event, 0.01);
+                }
+            }
+            //the clients:
+            std::atomic<int64_t> tick_start(0); //(steady_clock ns)
+            std::atomic<bool> done(false);
+            std::mutex latencies_mutex;
+            std::vector<double> latencies;
+            std::thread client_thread([&]() {
+                int epoll_fd = epoll_create1(0);
+                std::vector<std::vector<uint8_t>> buffers(clients.size());
+                for (size_t i = 0; i < clients.size(); ++i) {
+                    epoll_event event;
+                    event.events = EPOLLIN;
+                    event.data.u64 = i;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients[i], &event);
+                }
+                std::vector<epoll_event> events(256);
+                uint8_t data[65536];
+                while (!done) {
+                    int count = epoll_wait(epoll_fd, events.data(), int(events.size()), 10);
+                    for (int e = 0; e < count; ++e) {
+                        size_t i = size_t(events[e].data.u64);
+                        ssize_t ret = recv(clients[i], data, sizeof(data), MSG_DONTWAIT);
+                        if (ret <= 0) continue;
+                        auto &buffer = buffers[i];
+                        buffer.insert(buffer.end(), data, data + ret);
+                        //whole state message(s) in? then note the time and answer:
+                        while (buffer.size() >= 4) {
+                            uint32_t size = uint32_t(buffer[1]) | (uint32_t(buffer[2]) << 8) | (uint32_t(buffer[3]) << 16);
+                            if (buffer.size() < 4 + size) break;
+                            buffer.erase(buffer.begin(), buffer.begin() + 4 + size);
+                            auto now = std::chrono::steady_clock::now().time_since_epoch();
+                            double latency = double(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()
+                                                    - tick_start) * 1e-9;
+                            {
+                                std::lock_guard<std::mutex> lock(latencies_mutex);
+                                latencies.emplace_back(latency);
+                            }
+                            send(clients[i], Controls, sizeof(Controls), 0);
+                        }
+                    }
+                }
+                close(epoll_fd);
+            });
+
+            //ticks:
+            uint64_t syscalls_before = server.syscalls;
+            size_t ticks_done = 0;
+            double tick_time = time_steps(ticks, 10.0, [&]() {
+                size_t expected = received + sizeof(Controls) * clients.size();
+                auto now = std::chrono::steady_clock::now().time_since_epoch();
+                tick_start = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+                for (auto &c: server.connections) {
+                    game.send_state_message(&c, player, 0, Game::ProtocolVersion);
+                }
+                while (received < expected) {
+                    server.poll(on_event, 0.01);
+                }
+                ticks_done += 1;
+            });
+            double syscalls = double(server.syscalls - syscalls_before) / double(ticks_done);
+
+            done = true;
+            client_thread.join();
+            for (int s: clients) {
+                close(s);
+            }
+            while (!server.connections.empty()) {
+                server.poll(on_event, 0.01);
+            }
+            close(server.listen_socket);
+
+            std::sort(latencies.begin(), latencies.end());
+            auto percentile = [&](double p) {
+                return latencies[std::min(latencies.size() - 1, size_t(p * double(latencies.size())))];
+            };
+            std::cout << std::setw(8) << client_count << std::setw(10) << name
+                      << std::setw(16) << std::fixed << std::setprecision(1) << syscalls
+                      << std::setw(12) << std::fixed << std::setprecision(3) << percentile(0.5) * 1000.0
+                      << std::setw(12) << std::fixed << std::setprecision(3) << percentile(0.99) * 1000.0
+                      << std::setw(12) << std::fixed << std::setprecision(3) << latencies.back() * 1000.0
+                      << std::setw(14) << std::fixed << std::setprecision(3) << tick_time * 1000.0
+                      << std::endl;
+        }
+    }
+
+    std::cerr.rdbuf(cerr_buf);
+}
+#endif
+
+#ifdef __linux__
+//tick timing while lots of (local) clients flood the server with controls, with the server's single-threaded
+// main loop vs. the pipelined one (network on its own thread); see server.cpp:
+static void bench_pipeline(size_t ticks, std::vector<size_t> const &client_counts) {
+    std::cout << "Tick start lateness under network load (" << ticks << " ticks, 200 sheep):" << std::endl;
+    std::cout << std::setw(8) << "clients" << std::setw(11) << "loop" << std::setw(12) << "p50 (ms)"
+              << std::setw(12) << "p99 (ms)" << std::setw(12) << "max (ms)" << std::setw(16) << "inputs/tick"
+              << std::endl;
+
+    auto *cerr_buf = std::cerr.rdbuf(nullptr);
+
+    const uint8_t Controls[12] = {1, 8, 0, 0, 0, 0x81, 0, 0, 0, 0, 0, 0}; //(right held down, no mouse motion)
+
+    for (size_t client_count: client_counts) {
+        for (bool pipelined: {false, true}) {
+            Game game(200, 0x5eed);
+            std::unique_ptr<Server> server;
+            std::unique_ptr<NetworkThread> network;
+            if (pipelined) network = std::make_unique<NetworkThread>("0");
+            else server = std::make_unique<Server>("0");
+            sockaddr_storage address;
+            socklen_t address_size = server_address(pipelined ? network->server : *server, &address);
+
+            //the clients: each one sends a burst of controls every few milliseconds, and throws away what it gets:
+            std::atomic<bool> done(false);
+            std::atomic<size_t> connected(0);
+            std::thread load_thread([&]() {
+                std::vector<int> clients;
+                for (size_t i = 0; i < client_count; ++i) {
+                    int s = socket(address.ss_family, SOCK_STREAM, 0);
+                    if (s < 0 || connect(s, reinterpret_cast<sockaddr *>(&address), address_size) != 0) break;
+                    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+                    clients.emplace_back(s);
+                    connected += 1;
+                }
+                std::vector<uint8_t> burst;
+                for (uint32_t i = 0; i < 8; ++i) burst.insert(burst.end(), Controls, Controls + sizeof(Controls));
+                uint8_t data[65536];
+                while (!done) {
+                    for (int s: clients) {
+                        while (recv(s, data, sizeof(data), 0) > 0) { }
+                        send(s, burst.data(), burst.size(), MSG_NOSIGNAL);
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+                for (int s: clients) {
+                    close(s);
+                }
+            });
+
+            //the server (a trimmed-down copy of server.cpp's two main loops):
+            std::unordered_map<Connection *, Player::Handle> connection_player;
+            std::unordered_map<uint32_t, Player::Handle> client_player;
+            size_t inputs = 0;
+            std::vector<double> lateness;
+            auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration<double>(Game::Tick);
+            while (lateness.size() < ticks) {
+                if (pipelined) {
+                    std::this_thread::sleep_until(next_tick);
+                } else {
+                    while (true) {
+                        double remain = std::chrono::duration<double>(next_tick - std::chrono::steady_clock::now()).count();
+                        if (remain < 0.0) break;
+                        server->poll([&](Connection *c, Connection::Event evt) {
+                            if (evt == Connection::OnOpen) {
+                                connection_player.emplace(c, game.spawn_player());
+                            } else if (evt == Connection::OnClose) {
+                                game.remove_player(connection_player.at(c));
+                                connection_player.erase(c);
+                            } else {
+                                Player::Handle player = connection_player.at(c);
+                                while (game.players.controls[game.players.index(player)].recv_controls_message(c)) {
+                                    inputs += 1;
+                                }
+                            }
+                        }, remain);
+                    }
+                }
+                double late = std::chrono::duration<double>(std::chrono::steady_clock::now() - next_tick).count();
+                next_tick += std::chrono::duration<double>(Game::Tick);
+
+                if (pipelined) {
+                    NetworkThread::Input input;
+                    while (network->inputs.pop(&input)) {
+                        if (input.type == NetworkThread::Input::Open) {
+                            client_player.emplace(input.client, game.spawn_player());
+                        } else if (input.type == NetworkThread::Input::Close) {
+                            game.remove_player(client_player.at(input.client));
+                            client_player.erase(input.client);
+                        } else if (input.type == NetworkThread::Input::Controls) {
+                            input.add_controls_to(&game.players.controls[game.players.index(client_player.at(input.client))]);
+                            inputs += 1;
+                        }
+                    }
+                }
+
+                game.update(Game::Tick);
+
+                if (pipelined) {
+                    auto frame = std::make_unique<NetworkThread::Frame>();
+                    for (auto &[client, player]: client_player) {
+                        frame->emplace_back(NetworkThread::stage_state(game, client, player, 0, Game::ProtocolVersion));
+                    }
+                    network->publish(std::move(frame));
+                } else {
+                    for (auto &[c, player]: connection_player) {
+                        game.send_state_message(c, player, 0, Game::ProtocolVersion);
+                    }
+                }
+
+                //(only count ticks once everyone is connected)
+                if (game.players.size() == client_count && connected == client_count) {
+                    lateness.emplace_back(late);
+                } else {
+                    inputs = 0;
+                }
+            }
+
+            done = true;
+            load_thread.join();
+            network.reset();
+            server.reset();
+
+            std::sort(lateness.begin(), lateness.end());
+            auto percentile = [&](double p) {
+                return lateness[std::min(lateness.size() - 1, size_t(p * double(lateness.size())))];
+            };
+            std::cout << std::setw(8) << client_count << std::setw(11) << (pipelined ? "pipelined" : "single")
+                      << std::setw(12) << std::fixed << std::setprecision(3) << percentile(0.5) * 1000.0
+                      << std::setw(12) << std::fixed << std::setprecision(3) << percentile(0.99) * 1000.0
+                      << std::setw(12) << std::fixed << std::setprecision(3) << lateness.back() * 1000.0
+                      << std::setw(16) << std::fixed << std::setprecision(1) << double(inputs) / double(lateness.size())
+                      << std::endl;
+        }
+    }
+
+    std::cerr.rdbuf(cerr_buf);
+}
+#endif
+
+#ifdef __linux__
+//a "match" running in its own process, the way servers are run one per match:
+struct MatchProcess {
+    pid_t pid = -1;
+    int report_fd = -1; //(child -> bench) start-up time, then memory use
+    int release_fd = -1; //(bench -> child) closed when the child should measure its memory and exit
+};
+
+static MatchProcess start_match_process(std::string const &baked, std::vector<MatchProcess> const &others) {
+    int report[2], release[2];
+    if (pipe(report) != 0 || pipe(release) != 0) throw std::runtime_error("pipe() failed");
+    MatchProcess match;
+    match.pid = fork();
+    if (match.pid < 0) throw std::runtime_error("fork() failed");
+    if (match.pid == 0) {
+        close(report[0]);
+        close(release[1]);
+        //(don't hold on to other matches' pipes, or they won't see theirs close)
+        for (auto const &other: others) {
+            close(other.report_fd);
+            close(other.release_fd);
+        }
+        //start up the way server.cpp does, and run a few ticks:
+        auto before = std::chrono::steady_clock::now();
+        load_world_walkmeshes(baked);
+        Game game(Game::SheepCount, 0x5eed);
+        double startup = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+        for (uint32_t t = 0; t < 30; ++t) {
+            game.update(Game::Tick);
+        }
+        (void)!write(report[1], &startup, sizeof(startup));
+
+        //wait until every match is running, so pages that they share show up as shared:
+        char c;
+        (void)!read(release[0], &c, 1);
+        uint64_t memory[2] = {0, 0}; //private, shared (KiB)
+        std::ifstream smaps("/proc/self/smaps_rollup");
+        std::string field;
+        uint64_t kib;
+        while (smaps >> field) {
+            if (!(smaps >> kib)) {
+                smaps.clear();
+                continue;
+            }
+            if (field == "Private_Clean:" || field == "Private_Dirty:") memory[0] += kib;
+            if (field == "Shared_Clean:" || field == "Shared_Dirty:") memory[1] += kib;
+        }
+        (void)!write(report[1], memory, sizeof(memory));
+        _exit(0);
+    }
+    close(report[1]);
+    close(release[0]);
+    match.report_fd = report[0];
+    match.release_fd = release[1];
+    return match;
+}
+
+//reads all of a report (the child writes each part in one go, but pipes don't promise to deliver it in one go):
+static void read_report(int fd, void *data, size_t size) {
+    auto *at = reinterpret_cast<char *>(data);
+    while (size > 0) {
+        ssize_t ret = read(fd, at, size);
+        if (ret <= 0) throw std::runtime_error("match process didn't report");
+        at += ret;
+        size -= size_t(ret);
+    }
+}
+
+//starting many match processes on one machine: the first bakes the world, the rest map it:
+static void bench_attach(std::vector<size_t> const &process_counts) {
+    std::cout << "Match processes sharing the baked world (" << Game::SheepCount << " sheep each):" << std::endl;
+    std::cout << std::setw(12) << "start" << std::setw(11) << "processes" << std::setw(16) << "first (ms)"
+              << std::setw(16) << "others (ms)" << std::setw(16) << "private (KiB)" << std::setw(15) << "shared (KiB)"
+              << std::endl;
+
+    std::string baked = data_path("world.w.bench-baked");
+    for (bool together: {false, true}) {
+        for (size_t process_count: process_counts) {
+            std::remove(baked.c_str());
+
+            //one after the other (each one's start-up done before the next starts), or all at once:
+            std::vector<MatchProcess> matches;
+            std::vector<double> startups(process_count);
+            for (size_t i = 0; i < process_count; ++i) {
+                matches.emplace_back(start_match_process(baked, matches));
+                if (!together) read_report(matches[i].report_fd, &startups[i], sizeof(double));
+            }
+            if (together) {
+                for (size_t i = 0; i < process_count; ++i) {
+                    read_report(matches[i].report_fd, &startups[i], sizeof(double));
+                }
+            }
+
+            uint64_t private_kib = 0, shared_kib = 0;
+            for (auto &match: matches) {
+                close(match.release_fd);
+                uint64_t memory[2];
+                read_report(match.report_fd, memory, sizeof(memory));
+                private_kib += memory[0];
+                shared_kib += memory[1];
+                close(match.report_fd);
+                waitpid(match.pid, nullptr, 0);
+            }
+
+            double others = 0.0;
+            for (size_t i = 1; i < process_count; ++i) {
+                others += startups[i] / double(process_count - 1);
+            }
+            std::cout << std::setw(12) << (together ? "together" : "in turn") << std::setw(11) << process_count
+                      << std::setw(16) << std::fixed << std::setprecision(3) << startups[0] * 1000.0
+                      << std::setw(16) << std::fixed << std::setprecision(3) << others * 1000.0
+                      << std::setw(16) << private_kib / process_count
+                      << std::setw(15) << shared_kib / process_count << std::endl;
+        }
+    }
+    std::remove(baked.c_str());
+    std::remove((baked + ".lock").c_str());
+}
+#endif
+
+//Game::update single-threaded vs. on a worker pool (and check that they agree):
+static void bench_threads(size_t ticks, std::vector<size_t> const &sheep_counts) {
+    uint32_t threads = std::max(1U, std::thread::hardware_concurrency());
+    WorkerPool workers(threads - 1);
+
+    std::cout << "Game::update (ms per tick, " << ticks << " ticks or 10s budget), 1 vs. " << threads << " threads:"
+              << std::endl;
+    std::cout << std::setw(8) << "sheep" << std::setw(14) << "1 thread" << std::setw(14) << "pool"
+              << std::setw(10) << "speedup" << std::setw(12) << "identical" << std::endl;
+
+    for (size_t sheep_count: sheep_counts) {
+        Game game(sheep_count, 0x5eed);
+        for (uint32_t p = 0; p < 16; ++p) {
+            game.spawn_player();
+        }
+
+        Game parallel = game;
+        parallel.workers = &workers;
+
+        //run both for the same number of ticks so the results can be compared:
+        size_t serial_ticks = 0;
+        double serial_time = time_steps(ticks, 10.0, [&]() {
+            game.update(Game::Tick);
+            serial_ticks += 1;
+        });
+        auto before = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < serial_ticks; ++t) {
+            parallel.update(Game::Tick);
+        }
+        double parallel_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count()
+                               / double(serial_ticks);
+
+        bool identical = true;
+        for (size_t i = 0; i < sheep_count; ++i) {
+            if (std::memcmp(&game.sheeps.at[i], &parallel.sheeps.at[i], sizeof(WalkPoint)) != 0
+                || std::memcmp(&game.sheeps.rotation[i], &parallel.sheeps.rotation[i], sizeof(glm::quat)) != 0) {
+                identical = false;
+            }
+        }
+
+        std::cout << std::setw(8) << sheep_count
+                  << std::setw(14) << std::fixed << std::setprecision(3) << serial_time * 1000.0
+                  << std::setw(14) << std::fixed << std::setprecision(3) << parallel_time * 1000.0
+                  << std::setw(9) << std::fixed << std::setprecision(1) << serial_time / parallel_time << "x"
+                  << std::setw(12) << (identical ? "yes" : "NO") << std::endl;
+    }
+}
+
+//MatchManager::tick with many matches in one process, one after another vs. spread across a worker pool:
+static void bench_matches(size_t ticks, std::vector<size_t> const &match_counts) {
+    constexpr size_t Sheep = 200;
+    constexpr size_t Clients = 8;
+    uint32_t threads = std::max(1U, std::thread::hardware_concurrency());
+    WorkerPool workers(threads - 1);
+
+    std::cout << "MatchManager::tick (" << ticks << " ticks or 10s budget, " << Sheep << " sheep and " << Clients
+              << " clients per match), 1 vs. " << threads << " threads:" << std::endl;
+    std::cout << std::setw(8) << "matches" << std::setw(14) << "1 thread ms" << std::setw(14) << "pool ms"
+              << std::setw(16) << "pool ms/match" << std::setw(10) << "speedup" << std::setw(12) << "identical" << std::endl;
+
+    for (size_t match_count: match_counts) {
+        //same seed for both, so they should end up in the same place:
+        MatchManager serial(match_count, nullptr, Sheep, 0x5eed);
+        MatchManager parallel(match_count, &workers, Sheep, 0x5eed);
+        for (uint64_t c = 0; c < match_count * Clients; ++c) {
+            serial.add_client(c);
+            parallel.add_client(c);
+        }
+
+        //encode every client's state, like the pipelined server does:
+        std::vector<NetworkThread::Frame> staged(match_count);
+        auto stage = [&](MatchManager::Match &match, uint64_t client, ClientInfo &info) {
+            staged[match.index].emplace_back(NetworkThread::stage_state(match.game, uint32_t(client), info.player, info.acked, Game::ProtocolVersion));
+        };
+        auto clear = [&]() {
+            for (auto &frame: staged) frame.clear();
+        };
+
+        //run both for the same number of ticks so the results can be compared:
+        size_t serial_ticks = 0;
+        double serial_time = time_steps(ticks, 10.0, [&]() {
+            clear();
+            serial.tick(1, stage);
+            serial_ticks += 1;
+        });
+        auto before = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < serial_ticks; ++t) {
+            clear();
+            parallel.tick(1, stage);
+        }
+        double parallel_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count()
+                               / double(serial_ticks);
+
+        bool identical = true;
+        for (size_t m = 0; m < match_count; ++m) {
+            Game const &a = serial.matches[m]->game;
+            Game const &b = parallel.matches[m]->game;
+            for (size_t i = 0; i < Sheep; ++i) {
+                if (std::memcmp(&a.sheeps.at[i], &b.sheeps.at[i], sizeof(WalkPoint)) != 0
+                    || std::memcmp(&a.sheeps.rotation[i], &b.sheeps.rotation[i], sizeof(glm::quat)) != 0) {
+                    identical = false;
+                }
+            }
+        }
+
+        std::cout << std::setw(8) << match_count
+                  << std::setw(14) << std::fixed << std::setprecision(3) << serial_time * 1000.0
+                  << std::setw(14) << std::fixed << std::setprecision(3) << parallel_time * 1000.0
+                  << std::setw(16) << std::fixed << std::setprecision(3) << parallel_time * 1000.0 / double(match_count)
+                  << std::setw(9) << std::fixed << std::setprecision(1) << serial_time / parallel_time << "x"
+                  << std::setw(12) << (identical ? "yes" : "NO") << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    //when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+    try {
+#endif
+
+    //------------ argument parsing ------------
+
+    if (argc < 2) {
+        std::cerr << "Usage:\n\t./bench <benchmark> [args]\n"
+                  << "Benchmarks:\n"
+                  << "\ttick [ticks=100] [sheep counts...=15 1000 10000 50000]\n"
+                  << "\t    -- Game::update, spatial hash vs. all-pairs loop\n"
+                  << "\tnearest [queries=1000] [triangle counts...=10000 100000 1000000]\n"
+                  << "\t    -- WalkMesh::nearest_walk_point, bvh vs. checking every triangle\n"
+                  << "\tload [iterations=20] [triangle counts...=10000 100000 1000000]\n"
+                  << "\t    -- loading walkmeshes, from the exported file vs. from a baked copy\n"
+                  << "\tattach [unused] [process counts...=2 8 32]\n"
+                  << "\t    -- starting one process per match: start-up time and memory, with the world baked by the first\n"
+                  << "\twalk [ticks=100] [walker counts...=15 1000 10000 100000]\n"
+                  << "\t    -- moving many walkers a tick's worth, WalkMesh::walk on each vs. walk_many\n"
+                  << "\tstate [iterations=100] [sheep counts...=15 1000 10000 50000]\n"
+                  << "\t    -- encoding and decoding one client's state message, with each protocol version\n"
+                  << "\tplayers [iterations=100] [player counts...=16 255 256 1000]\n"
+                  << "\t    -- encoding and decoding state messages with many players, with each protocol version\n"
+                  << "\tdelta [ticks=100] [sheep counts...=15 1000 10000 50000]\n"
+                  << "\t    -- state message size, full vs. delta against the last acknowledged state\n"
+                  << "\tfanout [ticks=100] [sheep counts...=15 1000 10000 50000]\n"
+                  << "\t    -- sending a tick's state to 64 clients, encoded per client vs. shared\n"
+                  << "\tbacklog [iterations=100] [message counts...=1000 10000 100000]\n"
+                  << "\t    -- handling a backlog of controls messages in a connection's recv_buffer\n"
+                  << "\tconnections [rounds=100] [client counts...=100 400 5000]\n"
+                  << "\t    -- Server::poll with many local clients connected, select vs. epoll vs. io_uring\n"
+                  << "\tdelivery [ticks=100] [client counts...=100 600 2000]\n"
+                  << "\t    -- sending each tick's state to many local clients: syscalls per tick, delivery latency\n"
+                  << "\tpipeline [ticks=200] [client counts...=0 20 100]\n"
+                  << "\t    -- tick start lateness with clients flooding the server, single-threaded vs. pipelined loop\n"
+                  << "\tthreads [ticks=100] [sheep counts...=15 1000 10000 50000]\n"
+                  << "\t    -- Game::update on one thread vs. a worker pool with every core\n"
+                  << "\tmatches [ticks=100] [match counts...=1 4 16 64]\n"
+                  << "\t    -- ticking many matches in one process, one after another vs. on a worker pool with every core\n"
+                  << std::flush;
+        return 1;
+    }
+
+    std::string which = argv[1];
+    size_t iterations = (argc > 2 ? std::stoul(argv[2]) : 100);
+    std::vector<size_t> counts;
+    for (int i = 3; i < argc; ++i) {
+        counts.emplace_back(std::stoul(argv[i]));
+    }
+    if (counts.empty()) {
+        if (which == "connections") counts = {100, 400, 5000};
+        else if (which == "delivery") counts = {100, 600, 2000};
+        else if (which == "pipeline") counts = {0, 20, 100};
+        else if (which == "nearest") counts = {10000, 100000, 1000000};
+        else if (which == "attach") counts = {2, 8, 32};
+        else if (which == "load") counts = {10000, 100000, 1000000};
+        else if (which == "walk") counts = {15, 1000, 10000, 100000};
+        else if (which == "backlog") counts = {1000, 10000, 100000};
+        else if (which == "matches") counts = {1, 4, 16, 64};
+        else if (which == "players") counts = {16, 255, 256, 1000};
+        else counts = {15, 1000, 10000, 50000};
+    }
+
+    if (which == "tick") {
+        bench_tick(iterations, counts);
+    } else if (which == "nearest") {
+        bench_nearest(argc > 2 ? iterations : 1000, counts);
+    } else if (which == "load") {
+        bench_load(argc > 2 ? iterations : 20, counts);
+    } else if (which == "walk") {
+        bench_walk(iterations, counts);
+    } else if (which == "state") {
+        bench_state(iterations, counts);
+    } else if (which == "players") {
+        bench_players(iterations, counts);
+    } else if (which == "delta") {
+        bench_delta(iterations, counts);
+    } else if (which == "fanout") {
+        bench_fanout(iterations, counts);
+    } else if (which == "backlog") {
+        bench_backlog(iterations, counts);
+#ifndef _WIN32
+    } else if (which == "connections") {
+        bench_connections(iterations, counts);
+#endif
+#ifdef __linux__
+    } else if (which == "delivery") {
+        bench_delivery(iterations, counts);
+    } else if (which == "pipeline") {
+        bench_pipeline(argc > 2 ? iterations : 200, counts);
+    } else if (which == "attach") {
+        bench_attach(counts);
+#endif
+    } else if (which == "threads") {
+        bench_threads(iterations, counts);
+    } else if (which == "matches") {
+        bench_matches(iterations, counts);
+    } else {
+        std::cerr << "Unknown benchmark '" << which << "'." << std::endl;
+        return 1;
+    }
+
+    return 0;
+
+#ifdef _WIN32
+    } catch (std::exception const &e) {
+        std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "Unhandled exception (unknown type)." << std::endl;
+        throw;
+    }
+#endif
+}
@@ -0,0 +1,332 @@
+#include "Connection.hpp"
+
+#include "Game.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#ifdef _WIN32
+extern "C" { uint32_t GetACP(); }
+#endif
+
+//Headless load generator: connects a bunch of bots to a server (no window, no GL), has them play along
+// from a script, and reports what the server's traffic looked like from the clients' side.
+
+//what each bot does with its controls:
+enum class Script {
+    Idle, //nothing pressed (the server still has to send it states)
+    Circle, //walk forward while turning
+    Random, //hold a random set of direction buttons (changed every second or so) and look around
+};
+
+struct Bot {
+    Bot(std::string const &host, std::string const &port, uint64_t seed) : client(host, port), game(0), rng(seed) { }
+
+    Client client;
+    Game game; //(just the latest state from the server, and snapshots to decode deltas against)
+    Player::Controls controls;
+    Rng rng;
+    bool open = true;
+    bool malformed = false; //disconnected because a message from the server couldn't be decoded
+
+    size_t leftover = 0; //bytes in recv_buffer that were already counted
+
+    //stats:
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint32_t states = 0;
+    double decode_time = 0.0; //seconds, summed over all states
+    double decode_max = 0.0;
+    //arrival time (seconds since start) minus the snapshot's tick time (snapshot id * Game::Tick), one per state.
+    // The smallest of these is as close as this connection got to "on time", so how far each one is above
+    // that is how late that state was -- queued behind others, on a server that started its tick late, etc:
+    std::vector<double> arrival_offsets;
+
+    //queue a controls message (and count it):
+    void send_controls() {
+        size_t before = client.connection.send_buffer.size();
+        controls.send_controls_message(&client.connection);
+        bytes_out += client.connection.send_buffer.size() - before;
+
+        //reset button press counters:
+        controls.left.downs = 0;
+        controls.right.downs = 0;
+        controls.up.downs = 0;
+        controls.down.downs = 0;
+        controls.mousex = 0.0f;
+    }
+
+    //move controls along to the next message's worth of script:
+    void step_script(Script script, float rate) {
+        auto set = [](Button &button, bool pressed) {
+            if (pressed && !button.pressed) button.downs += 1;
+            button.pressed = pressed;
+        };
+        if (script == Script::Circle) {
+            set(controls.up, true);
+            controls.mousex = 0.25f / rate; //(a quarter of a screen height per second)
+        } else if (script == Script::Random) {
+            if (rng.unit() < 1.0f / rate) {
+                uint32_t bits = rng();
+                set(controls.left, bits & 1);
+                set(controls.right, bits & 2);
+                set(controls.up, bits & 4);
+                set(controls.down, bits & 8);
+            }
+            controls.mousex = (rng.unit() - 0.5f) * 0.5f / rate;
+        }
+    }
+
+    //handle whatever the server sent:
+    void recv(Connection *c, double now) {
+        bytes_in += c->recv_buffer.size() - leftover;
+
+        while (true) {
+            auto before = std::chrono::steady_clock::now();
+            if (!game.recv_state_message(c)) break;
+            double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+            decode_time += took;
+            decode_max = std::max(decode_max, took);
+            states += 1;
+            arrival_offsets.emplace_back(now - double(game.snapshots.back()->id) * double(Game::Tick));
+
+            //let the server know which state we have, so it can send the next one as changes from this one:
+            size_t queued = c->send_buffer.size();
+            game.send_ack_message(c);
+            bytes_out += c->send_buffer.size() - queued;
+        }
+
+        leftover = c->recv_buffer.size();
+    }
+};
+
+//value at fraction 'p' of the way through sorted 'values' (0 if empty):
+static double percentile(std::vector<double> const &values, double p) {
+    if (values.empty()) return 0.0;
+    return values[std::min(values.size() - 1, size_t(p * double(values.size())))];
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+    { //when compiled on windows, check that code page is forced to utf-8 (makes file loading/saving work right):
+        //see: https://docs.microsoft.com/en-us/windows/apps/design/globalizing/use-utf8-code-page
+        uint32_t code_page = GetACP();
+        if (code_page == 65001) {
+            std::cout << "Code page is properly set to UTF-8." << std::endl;
+        } else {
+            std::cout << "WARNING: code page is set to " << code_page << " instead of 65001 (UTF-8). Some file handling functions may fail." << std::endl;
+        }
+    }
+
+    //when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+    try {
+#endif
+
+    //------------ argument parsing ------------
+
+    size_t bot_count = 50;
+    float rate = 30.0f; //controls messages per second, per bot
+    double seconds = 30.0;
+    Script script = Script::Random;
+    uint64_t seed = 0;
+    std::string csv; //if set, write per-connection stats here
+    std::vector<std::string> args;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = (i + 1 < argc);
+            if (arg == "--bots" && has_value) bot_count = std::stoul(argv[++i]);
+            else if (arg == "--rate" && has_value) rate = std::stof(argv[++i]);
+            else if (arg == "--seconds" && has_value) seconds = std::stod(argv[++i]);
+            else if (arg == "--seed" && has_value) seed = std::stoull(argv[++i]);
+            else if (arg == "--csv" && has_value) csv = argv[++i];
+            else if (arg == "--script" && has_value) {
+                std::string name = argv[++i];
+                if (name == "idle") script = Script::Idle;
+                else if (name == "circle") script = Script::Circle;
+                else if (name == "random") script = Script::Random;
+                else throw std::invalid_argument("unknown script '" + name + "'");
+            }
+            else args.emplace_back(arg);
+        }
+    } catch (std::exception const &e) {
+        std::cerr << "Bad argument: " << e.what() << std::endl;
+        args.clear();
+    }
+
+    if (args.size() != 2 || bot_count == 0 || !(rate > 0.0f)) {
+        std::cerr << "Usage:\n\t./bots <host> <port> [--bots 50] [--rate 30] [--seconds 30] [--script idle|circle|random] [--seed 0] [--csv <file>]\n"
+                  << "\t(bots poll with select(), so keep --bots under about a thousand)\n"
+                  << "\t(one match takes at most " << Game::MaxPlayers << " players; the server turns away the rest unless run with --matches)\n"
+                  << "\t(exits with an error if any bot got a message it couldn't decode)" << std::endl;
+        return 1;
+    }
+
+    //------------ connect ------------
+
+    std::vector<std::unique_ptr<Bot>> bots;
+    bots.reserve(bot_count);
+    for (size_t i = 0; i < bot_count; ++i) {
+        bots.emplace_back(std::make_unique<Bot>(args[0], args[1], seed + i));
+        //ask for the compact state encoding:
+        Game::send_hello_message(&bots.back()->client.connection);
+    }
+
+    std::cout << "Connected " << bots.size() << " bots; running for " << seconds << "s." << std::endl;
+
+    //------------ main loop ------------
+
+    auto start = std::chrono::steady_clock::now();
+    auto seconds_since_start = [&]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    double next_controls = 0.0;
+    double next_report = 1.0;
+    uint32_t reported_states = 0;
+    while (true) {
+        double now = seconds_since_start();
+        if (now >= seconds) break;
+
+        if (now >= next_controls) {
+            next_controls += 1.0 / double(rate);
+            //(if we fell behind, skip ahead rather than sending a burst)
+            if (next_controls < now) next_controls = now + 1.0 / double(rate);
+            for (auto &bot: bots) {
+                if (!bot->open) continue;
+                bot->step_script(script, rate);
+                bot->send_controls();
+            }
+        }
+
+        for (auto &bot: bots) {
+            if (!bot->open) continue;
+            bot->client.poll([&](Connection *c, Connection::Event event) {
+                if (event == Connection::OnClose) {
+                    bot->open = false;
+                } else if (event == Connection::OnRecv) {
+                    try {
+                        bot->recv(c, seconds_since_start());
+                    } catch (std::exception const &e) {
+                        std::cerr << "[" << c->socket << "] malformed message from server: " << e.what() << std::endl;
+                        c->close();
+                        bot->open = false;
+                        bot->malformed = true;
+                    }
+                }
+            }, 0.0);
+        }
+
+        if (now >= next_report) {
+            next_report += 1.0;
+            uint32_t states = 0;
+            size_t open = 0;
+            for (auto const &bot: bots) {
+                states += bot->states;
+                open += (bot->open ? 1 : 0);
+            }
+            std::cout << "  " << std::setw(4) << size_t(std::round(now)) << "s: " << open << " open, "
+                      << (states - reported_states) << " states received" << std::endl;
+            reported_states = states;
+        }
+
+        //(states arrive once a tick, so a millisecond of sleep doesn't cost much arrival-time accuracy)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    double elapsed = seconds_since_start();
+
+    //------------ report ------------
+
+    std::vector<double> lags; //(ms, all connections)
+    std::vector<double> connection_lag_99; //(ms, one per connection)
+    double decode_time = 0.0;
+    double decode_max = 0.0;
+    uint64_t bytes_in = 0, bytes_out = 0, states = 0;
+    size_t closed = 0;
+    size_t malformed = 0;
+
+    std::ofstream csv_out;
+    if (!csv.empty()) {
+        csv_out.open(csv);
+        if (!csv_out) throw std::runtime_error("Failed to open '" + csv + "' for writing.");
+        csv_out << "bot,open,states,bytes_in_per_s,bytes_out_per_s,decode_us_mean,decode_us_max,lag_ms_p50,lag_ms_p99,lag_ms_max\n";
+    }
+
+    for (size_t i = 0; i < bots.size(); ++i) {
+        Bot const &bot = *bots[i];
+
+        std::vector<double> bot_lags;
+        bot_lags.reserve(bot.arrival_offsets.size());
+        if (!bot.arrival_offsets.empty()) {
+            double best = *std::min_element(bot.arrival_offsets.begin(), bot.arrival_offsets.end());
+            for (double offset: bot.arrival_offsets) {
+                bot_lags.emplace_back((offset - best) * 1000.0);
+            }
+        }
+        std::sort(bot_lags.begin(), bot_lags.end());
+        lags.insert(lags.end(), bot_lags.begin(), bot_lags.end());
+        connection_lag_99.emplace_back(percentile(bot_lags, 0.99));
+
+        decode_time += bot.decode_time;
+        decode_max = std::max(decode_max, bot.decode_max);
+        bytes_in += bot.bytes_in;
+        bytes_out += bot.bytes_out;
+        states += bot.states;
+        closed += (bot.open ? 0 : 1);
+        malformed += (bot.malformed ? 1 : 0);
+
+        if (csv_out.is_open()) {
+            csv_out << i << ',' << (bot.open ? 1 : 0) << ',' << bot.states
+                    << ',' << double(bot.bytes_in) / elapsed << ',' << double(bot.bytes_out) / elapsed
+                    << ',' << (bot.states ? bot.decode_time / bot.states * 1e6 : 0.0) << ',' << bot.decode_max * 1e6
+                    << ',' << percentile(bot_lags, 0.5) << ',' << percentile(bot_lags, 0.99)
+                    << ',' << (bot_lags.empty() ? 0.0 : bot_lags.back()) << '\n';
+        }
+    }
+    std::sort(lags.begin(), lags.end());
+    std::sort(connection_lag_99.begin(), connection_lag_99.end());
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Ran " << bots.size() << " bots for " << elapsed << "s (" << closed << " disconnected, "
+              << malformed << " of them over malformed messages):\n"
+              << "  states:  " << double(states) / elapsed / double(bots.size()) << " per second per bot\n"
+              << "  traffic: " << double(bytes_in) / elapsed / 1024.0 << " KiB/s in, "
+              << double(bytes_out) / elapsed / 1024.0 << " KiB/s out ("
+              << double(bytes_in) / elapsed / 1024.0 / double(bots.size()) << " / "
+              << double(bytes_out) / elapsed / 1024.0 / double(bots.size()) << " per bot)\n"
+              << "  decode:  " << (states ? decode_time / double(states) * 1e6 : 0.0) << " us mean, "
+              << decode_max * 1e6 << " us max\n"
+              << "  lag:     " << percentile(lags, 0.5) << " ms median, " << percentile(lags, 0.99) << " ms 99th, "
+              << (lags.empty() ? 0.0 : lags.back()) << " ms max (vs. each connection's most punctual state)\n"
+              << "  worst connection's 99th percentile lag: "
+              << (connection_lag_99.empty() ? 0.0 : connection_lag_99.back()) << " ms" << std::endl;
+
+    //(a bot that couldn't decode what the server sent means client and server disagree -- not just a busy server)
+    if (malformed) {
+        std::cerr << malformed << " bots disconnected over malformed messages from the server." << std::endl;
+        return 1;
+    }
+
+    return 0;
+
+#ifdef _WIN32
+    } catch (std::exception const &e) {
+        std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "Unhandled exception (unknown type)." << std::endl;
+        throw;
+    }
+#endif
+}
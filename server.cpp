@@ -2,17 +2,131 @@
 #include "Connection.hpp"
 
 #include "Game.hpp"
+#include "WorkerPool.hpp"
+#include "NetworkThread.hpp"
+#include "MatchManager.hpp"
+#include "Profiler.hpp"
+#include "TickScheduler.hpp"
 
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
 #include <unordered_map>
+#include <unordered_set>
 #include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <optional>
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
 #endif
 
+//with "--profile <file>", the tick profile is written there this often (seconds):
+static constexpr double ProfileInterval = 5.0;
+
+//finish a tick's profile, and write it out if it's been long enough since the last time:
+static void end_profile_tick(Profiler *profiler, std::string const &path) {
+    if (!profiler) return;
+    profiler->end_tick();
+    
+    static auto next_write = std::chrono::steady_clock::now() + std::chrono::duration<double>(ProfileInterval);
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_write) return;
+    next_write = now + std::chrono::duration<double>(ProfileInterval);
+    try {
+        profiler->write(path);
+    } catch (std::exception const &e) {
+        std::cerr << "WARNING: couldn't write profile: " << e.what() << std::endl;
+    }
+}
+
+//pipelined main loop: sockets are handled on a NetworkThread, so nothing the network does can hold up a tick.
+// Each tick starts on schedule (catching up, if need be, like the single-threaded loop), takes whatever input arrived
+// since the last one, updates, and hands the encoded states back to the network thread to send:
+// (only the simulation thread is profiled, so poll and flush don't show up; decode is applying the inputs)
+static void run_pipelined(std::string const &port, MatchManager &matches, Profiler *profiler, std::string const &profile_path) {
+    NetworkThread network(port);
+    
+    //(clients are keyed by NetworkThread client number)
+    
+    //each match stages its clients' states separately (matches may be encoding at the same time):
+    std::vector<NetworkThread::Frame> staged(matches.matches.size());
+    
+    //clients there was no room for, until the network thread says they're closed
+    // (asked to close every tick, since a frame might get dropped):
+    std::unordered_set<uint32_t> refused;
+    
+    TickScheduler schedule(Game::Tick);
+    schedule.profiler = profiler;
+    while (true) {
+        std::this_thread::sleep_until(schedule.next);
+        uint32_t steps = schedule.start_tick();
+        
+        std::optional<Profiler::Scope> tick_scope, decode_scope;
+        tick_scope.emplace(profiler, Profiler::Tick);
+        decode_scope.emplace(profiler, Profiler::Decode);
+        
+        //apply input that arrived since last tick:
+        NetworkThread::Input input;
+        while (network.inputs.pop(&input)) {
+            if (input.type == NetworkThread::Input::Open) {
+                if (!matches.add_client(input.client)) {
+                    std::cout << "Turning away client " << input.client << ": every match is full." << std::endl;
+                    refused.emplace(input.client);
+                }
+                continue;
+            }
+            if (input.type == NetworkThread::Input::Close) {
+                if (refused.erase(input.client) == 0) matches.remove_client(input.client);
+                continue;
+            }
+            if (refused.count(input.client)) continue;
+            auto [match, info] = matches.client(input.client);
+            if (input.type == NetworkThread::Input::Controls) {
+                input.add_controls_to(&match.game.players.controls[match.game.players.index(info.player)]);
+            } else if (input.type == NetworkThread::Input::Hello) {
+                info.set_version(uint8_t(input.value), match.game.tick);
+            } else if (input.type == NetworkThread::Input::Ack) {
+                info.ack(input.value);
+            }
+        }
+        
+        decode_scope.reset();
+        
+        //update every match, encoding updated game state for its clients:
+        for (auto &frame: staged) {
+            frame.clear();
+        }
+        matches.tick(steps, [&](MatchManager::Match &match, uint64_t client, ClientInfo &info) {
+            Profiler::Scope scope(profiler, Profiler::Encode);
+            staged[match.index].emplace_back(NetworkThread::stage_state(match.game, uint32_t(client), info.player, info.acked, info.version));
+        });
+        
+        //...and hand it all to the network thread to send:
+        auto frame = std::make_unique<NetworkThread::Frame>();
+        frame->reserve(matches.client_count() + refused.size());
+        for (auto &part: staged) {
+            for (auto &output: part) {
+                frame->emplace_back(std::move(output));
+            }
+        }
+        for (uint32_t client: refused) {
+            NetworkThread::Output output;
+            output.client = client;
+            output.close = true;
+            frame->emplace_back(std::move(output));
+        }
+        network.publish(std::move(frame));
+        
+        schedule.end_tick();
+        tick_scope.reset();
+        end_profile_tick(profiler, profile_path);
+    }
+}
+
 int main(int argc, char **argv) {
 #ifdef _WIN32
     { //when compiled on windows, check that code page is forced to utf-8 (makes file loading/saving work right):
@@ -31,87 +145,181 @@ int main(int argc, char **argv) {
     
     //------------ argument parsing ------------
     
-    if (argc != 2) {
-        std::cerr << "Usage:\n\t./server <port>" << std::endl;
+    //"--pipelined" (anywhere) runs the network on its own thread:
+    bool pipelined = false;
+    //"--world-cache <file>" keeps the baked walkmeshes there rather than next to world.w
+    // (e.g., somewhere in /dev/shm, for servers whose data directory is read-only):
+    std::string world_cache;
+    //"--matches <count>" hosts that many separate matches (new clients join whichever has the fewest players):
+    int match_count = 1;
+    //"--profile <file>" keeps a tick profile (time per phase, see Profiler) there, rewritten every few seconds:
+    std::string profile_path;
+    //"--degrade-lagging" sends states less often to clients that have fallen far behind (see MatchManager):
+    bool degrade_lagging = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--pipelined") pipelined = true;
+        else if (std::string(argv[i]) == "--degrade-lagging") degrade_lagging = true;
+        else if (std::string(argv[i]) == "--world-cache" && i + 1 < argc) world_cache = argv[++i];
+        else if (std::string(argv[i]) == "--matches" && i + 1 < argc) match_count = std::stoi(argv[++i]);
+        else if (std::string(argv[i]) == "--profile" && i + 1 < argc) profile_path = argv[++i];
+        else args.emplace_back(argv[i]);
+    }
+    
+    if ((args.size() != 1 && args.size() != 2) || match_count < 1) {
+        std::cerr << "Usage:\n\t./server <port> [simulation threads] [--pipelined] [--world-cache <file>] [--matches <count>] [--profile <file>] [--degrade-lagging]" << std::endl;
         return 1;
     }
     
+    //by default, the simulation uses every core:
+    uint32_t threads = std::max(1U, std::thread::hardware_concurrency());
+    if (args.size() == 2) {
+        threads = std::max(1, std::stoi(args[1]));
+    }
+    
     //------------ initialization ------------
     
-    Server server(argv[1]);
+    //(the main thread also works on the simulation, so the pool only needs the rest of the threads)
+    WorkerPool workers(threads - 1);
     
-    //------------ main loop ------------
+    //the world is shared with every other server on this machine (the first one to start bakes it, the rest just map it):
+    load_world_walkmeshes(world_cache);
     
-    //keep track of which connection is controlling which player:
-    std::unordered_map<Connection *, Player *> connection_to_player;
     //keep track of game state:
-    Game game;
+    MatchManager matches(size_t(match_count), &workers);
+    matches.degrade_lagging = degrade_lagging;
     
-    while (true) {
-        static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration<double>(Game::Tick);
-        //process incoming data from clients until a tick has elapsed:
-        while (true) {
-            auto now = std::chrono::steady_clock::now();
-            double remain = std::chrono::duration<double>(next_tick - now).count();
-            if (remain < 0.0) {
-                next_tick += std::chrono::duration<double>(Game::Tick);
-                break;
+    Profiler profiler;
+    Profiler *profile = (profile_path.empty() ? nullptr : &profiler);
+    matches.profiler = profile;
+    for (auto &match: matches.matches) {
+        match->game.profiler = profile;
+    }
+    
+    if (pipelined) {
+        run_pipelined(args[0], matches, profile, profile_path);
+        return 0;
+    }
+    
+    Server server(args[0]);
+    
+    //------------ main loop ------------
+    
+    //clients are keyed by Connection pointer:
+    auto key = [](Connection *c) { return uint64_t(reinterpret_cast<uintptr_t>(c)); };
+    
+    auto on_event = [&](Connection *c, Connection::Event evt) {
+        if (evt == Connection::OnOpen) {
+            //client connected:
+            
+            //put them in a match (or, if there's no room, turn them away):
+            if (!matches.add_client(key(c))) {
+                std::cout << "Turning away client: every match is full." << std::endl;
+                c->close();
             }
             
-            //helper used on client close (due to quit) and server close (due to error):
-            auto remove_connection = [&](Connection *c) {
-                auto f = connection_to_player.find(c);
-                assert(f != connection_to_player.end());
-                game.remove_player(f->second);
-                connection_to_player.erase(f);
-            };
+        } else if (evt == Connection::OnClose) {
+            //client disconnected:
             
-            server.poll([&](Connection *c, Connection::Event evt) {
-                if (evt == Connection::OnOpen) {
-                    //client connected:
-                    
-                    //create some player info for them:
-                    connection_to_player.emplace(c, game.spawn_player());
-                    
-                } else if (evt == Connection::OnClose) {
-                    //client disconnected:
-                    
-                    remove_connection(c);
-                    
-                } else {
-                    assert(evt == Connection::OnRecv);
-                    //got data from client:
-                    //std::cout << "current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush(); //DEBUG
-                    
-                    //look up in players list:
-                    auto f = connection_to_player.find(c);
-                    assert(f != connection_to_player.end());
-                    Player &player = *f->second;
-                    
-                    //handle messages from client:
-                    try {
-                        bool handled_message;
-                        do {
-                            handled_message = false;
-                            if (player.controls.recv_controls_message(c)) handled_message = true;
-                        } while (handled_message);
-                    } catch (std::exception const &e) {
-                        std::cout << "Disconnecting client:" << e.what() << std::endl;
-                        c->close();
-                        remove_connection(c);
+            matches.remove_client(key(c));
+            
+        } else {
+            assert(evt == Connection::OnRecv);
+            //got data from client:
+            //std::cout << "current buffer:\n" << hex_dump(c->recv_buffer.data(), c->recv_buffer.size()); std::cout.flush(); //DEBUG
+            
+            Profiler::Scope scope(profile, Profiler::Decode);
+            size_t unhandled = c->recv_buffer.size();
+            
+            //look up in players list:
+            auto [match, info] = matches.client(key(c));
+            Player::Controls &controls = match.game.players.controls[match.game.players.index(info.player)];
+            
+            //handle messages from client:
+            try {
+                bool handled_message;
+                do {
+                    handled_message = false;
+                    if (controls.recv_controls_message(c)) handled_message = true;
+                    uint8_t version;
+                    if (Game::recv_hello_message(c, &version)) {
+                        info.set_version(version, match.game.tick);
+                        handled_message = true;
                     }
-                }
-            }, remain);
+                    uint32_t acked;
+                    if (Game::recv_ack_message(c, &acked)) {
+                        info.ack(acked);
+                        handled_message = true;
+                    }
+                } while (handled_message);
+            } catch (std::exception const &e) {
+                std::cout << "Disconnecting client:" << e.what() << std::endl;
+                c->close();
+                matches.remove_client(key(c));
+            }
+            
+            if (profile) profile->add(Profiler::Decode, 0.0, unhandled - c->recv_buffer.size());
+        }
+    };
+    
+    //poll, and (if profiling) count the time it spent working -- not waiting or decoding -- as 'phase':
+    auto poll = [&](Profiler::Phase phase, double timeout) {
+        if (!profile) {
+            server.poll(on_event, timeout);
+            return;
         }
+        auto before = std::chrono::steady_clock::now();
+        double waited = server.waited;
+        uint64_t decode_ns = profile->tick_ns[Profiler::Decode].load();
+        uint64_t bytes = server.bytes_received + server.bytes_sent;
         
-        //update current game state
-        game.update(Game::Tick);
+        server.poll(on_event, timeout);
         
-        //send updated game state to all clients
-        for (auto &[c, player]: connection_to_player) {
-            game.send_state_message(c, player);
+        double took = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count()
+                      - (server.waited - waited)
+                      - double(profile->tick_ns[Profiler::Decode].load() - decode_ns) * 1e-9;
+        profile->add(phase, std::max(0.0, took), server.bytes_received + server.bytes_sent - bytes);
+    };
+    
+    //(a tick's work is everything since the last one ended, other than waiting)
+    auto tick_start = std::chrono::steady_clock::now();
+    double tick_start_waited = server.waited;
+    
+    TickScheduler schedule(Game::Tick);
+    schedule.profiler = profile;
+    
+    while (true) {
+        //process incoming data from clients until a tick is due:
+        while (true) {
+            double remain = schedule.remain();
+            if (remain <= 0.0) break;
+            
+            poll(Profiler::Poll, remain);
         }
         
+        //if the last tick ran long, this one runs the missed steps too (but still only sends once):
+        uint32_t steps = schedule.start_tick();
+        
+        //update every match, and send updated game state to its clients
+        // (as a delta against the last state each one acknowledged -- if that's too old, send_state_message falls back to a full state)
+        matches.tick(steps, [&](MatchManager::Match &match, uint64_t client, ClientInfo &info) {
+            Profiler::Scope scope(profile, Profiler::Encode);
+            match.game.send_state_message(reinterpret_cast<Connection *>(uintptr_t(client)), info.player, info.acked, info.version);
+        });
+        
+        //get the states on their way now, rather than whenever the next poll happens to
+        // (this also makes sure the network gets a look in between ticks, even when catching up):
+        poll(Profiler::Flush, 0.0);
+        
+        schedule.end_tick();
+        
+        if (profile) {
+            auto now = std::chrono::steady_clock::now();
+            profile->add(Profiler::Tick, std::chrono::duration<double>(now - tick_start).count() - (server.waited - tick_start_waited));
+            tick_start = now;
+            tick_start_waited = server.waited;
+        }
+        end_profile_tick(profile, profile_path);
     }
     
     
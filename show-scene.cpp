@@ -112,8 +112,7 @@ int main(int argc, char **argv) {
                 if (!buffer_vao) return;
                 Mesh const &mesh = buffer->lookup(mesh_name);
                 
-                scene.drawables.emplace_back(transform);
-                Scene::Drawable &drawable = scene.drawables.back();
+                Scene::Drawable &drawable = scene.add_drawable(transform);
                 
                 drawable.pipeline = show_scene_program_pipeline;
                 
@@ -121,6 +120,8 @@ int main(int argc, char **argv) {
                 drawable.pipeline.type = mesh.type;
                 drawable.pipeline.start = mesh.start;
                 drawable.pipeline.count = mesh.count;
+                drawable.pipeline.min = mesh.min;
+                drawable.pipeline.max = mesh.max;
                 
             });
         } catch (std::exception &e) {